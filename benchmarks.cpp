@@ -0,0 +1,218 @@
+#include <nanobench.h>
+#include <cmath>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <sstream>
+#include "regression.h"
+#include "utils.h"
+
+// Every hot kernel of the search on its own, at the magnitudes a search runs
+// at, with nanobench's JSON for all of them written out to compare across
+// commits. Given a baseline from an earlier run, exits with 1 when a kernel
+// got slower than the threshold allows.
+
+const char usage[] =
+    "usage: benchmarks [options]\n"
+    "  -o, --output F      write the results as nanobench JSON to F (default benchmarks.json)\n"
+    "  -c, --compare F     compare with the results of an earlier run kept in F\n"
+    "  -t, --threshold P   percent slowdown beyond the error bars that fails --compare (default 5)\n"
+    "  -f, --filter S      only run the benchmarks whose name contains S, such as \"at 10^13\"\n"
+    "  -h, --help          print this help\n"
+    "Exits with 1 on a regression and 2 on an error.\n";
+
+namespace {
+
+struct magnitude {
+    const char *name;
+    uint64_t n;
+};
+
+constexpr magnitude magnitudes[] {
+    {"10^9", 1'000'000'000ull},
+    {"10^12", 1'000'000'000'000ull},
+    {"10^13", 10'000'000'000'000ull},
+    {"10^15", 1'000'000'000'000'000ull},
+    {"2^63", 9'223'372'036'854'775'808ull},
+};
+
+constexpr uint64_t window {1'000'000};
+
+// long enough that the sieve benchmark never runs out of segments
+constexpr uint64_t sieve_span {uint64_t{1} << 36};
+
+// For n above the primes of trial division.
+bool is_prime(uint64_t n) {
+    factors f;
+    return factor_small(n, &f) == n && cofactor_is_prime(n);
+}
+
+// The first count primes from start, without base primes up to sqrt(start).
+std::vector<uint64_t> primes_from(uint64_t start, std::size_t count) {
+    std::vector<uint64_t> found;
+    for(uint64_t n = start | 1; found.size() != count; n += 2) {
+        if(is_prime(n)) found.push_back(n);
+    }
+    return found;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    const option long_options[] {
+        {"output", required_argument, nullptr, 'o'},
+        {"compare", required_argument, nullptr, 'c'},
+        {"threshold", required_argument, nullptr, 't'},
+        {"filter", required_argument, nullptr, 'f'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+    std::string path = "benchmarks.json", baseline_path, filter;
+    double threshold {0.05};
+    for(int c; (c = getopt_long(argc, argv, "o:c:t:f:h", long_options, nullptr)) != -1;) {
+        switch(c) {
+            case 'o': path = optarg; break;
+            case 'c': baseline_path = optarg; break;
+            case 't': {
+                char *end;
+                threshold = std::strtod(optarg, &end) / 100;
+                if(end == optarg || *end || !std::isfinite(threshold) || threshold < 0) {
+                    std::cerr << "benchmarks: not a threshold: " << optarg << '\n' << usage;
+                    return 2;
+                }
+                break;
+            }
+            case 'f': filter = optarg; break;
+            case 'h': std::cout << usage; return 0;
+            default: std::cerr << usage; return 2;
+        }
+    }
+    if(optind != argc) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    // read first, so a missing baseline fails before the benchmarks run
+    std::vector<benchmark_result> baseline;
+    if(!baseline_path.empty()) {
+        std::ifstream file(baseline_path);
+        std::stringstream text;
+        text << file.rdbuf();
+        try {
+            if(!file) throw std::runtime_error("cannot read it");
+            baseline = parse_results(text.str());
+        }
+        catch(const std::runtime_error &e) {
+            std::cerr << "benchmarks: " << baseline_path << ": " << e.what() << '\n';
+            return 2;
+        }
+    }
+
+    ankerl::nanobench::Bench bench;
+    bench.title("ord23 kernels");
+
+    // a new unit clears the results of the bench, so they are kept here
+    std::vector<ankerl::nanobench::Result> results;
+    const auto selected = [&](const std::string &name) {return name.find(filter) != std::string::npos;};
+    const auto run = [&](const std::string &name, auto &&f) {
+        if(!selected(name)) return;
+        bench.run(name, f);
+        results.push_back(bench.results().back());
+    };
+
+    for(const auto &[name, n] : magnitudes) {
+        const std::string at = std::string(" at ") + name;
+        const auto sample = primes_from(n, 2000);
+
+        // past 10^15 the base primes run into the hundreds of millions and a
+        // single pass takes seconds
+        bench.epochs(n > 1'000'000'000'000'000ull ? 3 : 11);
+        std::vector<unsigned> primes;
+        bench.batch(1).unit("call");
+        run("base primes" + at, [&] {
+            primes = base_primes(n + window);
+            ankerl::nanobench::doNotOptimizeAway(primes);
+        });
+
+        // one segment at a time, as in the middle of a block: the base primes
+        // join the sieve in its first segment, before the timing starts
+        if(selected("window sieve" + at)) {
+            const auto base = base_primes(n + sieve_span);
+            segmented_sieve sieve(base, n, n + sieve_span);
+            std::vector<uint64_t> segment;
+            sieve.next(segment);
+            bench.epochs(11).batch(sieve.position() - (n & ~uint64_t{1})).unit("number");
+            run("window sieve" + at, [&] {
+                segment.clear();
+                ankerl::nanobench::doNotOptimizeAway(sieve.next(segment));
+            });
+        }
+
+        bench.epochs(11).batch(sample.size()).unit("prime");
+        run("factor p - 1" + at, [&] {
+            factors f;
+            for(auto p : sample) {
+                factor(p - 1, &f);
+                ankerl::nanobench::doNotOptimizeAway(f);
+            }
+        });
+
+        run("prime_p" + at, [&] {
+            for(auto p : sample) ankerl::nanobench::doNotOptimizeAway(cofactor_is_prime(p));
+        });
+
+        run("modpow_two and modpow_three" + at, [&] {
+            for(auto p : sample) {
+                const montgomery m(p);
+                ankerl::nanobench::doNotOptimizeAway(modpow_two(p - 1, m) + modpow_three(p - 1, m));
+            }
+        });
+
+        std::vector<factorization> sample_factors;
+        for(auto p : sample) sample_factors.push_back(factorize(p - 1));
+        run("order_two and order_three" + at, [&] {
+            for(std::size_t i = 0; i != sample.size(); ++i) {
+                const montgomery m(sample[i]);
+                const auto mo2 = order_two(sample_factors[i], m);
+                ankerl::nanobench::doNotOptimizeAway(order_three(sample_factors[i], m, mo2));
+            }
+        });
+
+        // products of two primes near sqrt(n), past trial division
+        const auto root = isqrt(n);
+        const auto low = primes_from(root / 2, 100), high = primes_from(2 * root, 100);
+        std::vector<uint64_t> semiprimes;
+        for(std::size_t i = 0; i != low.size(); ++i) semiprimes.push_back(low[i] * high[i]);
+        bench.batch(semiprimes.size()).unit("cofactor");
+        run("Pollard rho" + at, [&] {
+            factors f;
+            for(auto c : semiprimes) {
+                factor(c, &f);
+                ankerl::nanobench::doNotOptimizeAway(f);
+            }
+        });
+    }
+
+    if(results.empty()) {
+        std::cerr << "benchmarks: no benchmark matches " << filter << '\n';
+        return 2;
+    }
+
+    std::ostringstream json;
+    ankerl::nanobench::render(ankerl::nanobench::templates::json(), results, json);
+    std::ofstream file(path);
+    if(!(file << json.str()) || !file.flush()) {
+        std::cerr << "benchmarks: cannot write " << path << '\n';
+        return 2;
+    }
+    if(baseline_path.empty()) return 0;
+
+    const auto changes = compare(baseline, parse_results(json.str()), threshold);
+    std::cout << "\nagainst " << baseline_path << ":\n" << report(changes);
+    const auto regressions = std::count_if(changes.begin(), changes.end(), [](const auto &c) {return c.regressed;});
+    if(regressions) {
+        std::cout << regressions << " benchmarks slower by more than " << 100 * threshold << "% beyond their error bars\n";
+        return 1;
+    }
+    return 0;
+}
@@ -84,6 +84,12 @@
 # define PROVE_PRIMALITY 1
 #endif
 
+/* Whether prime_p, for 64-bit n, proves primality with a fixed set of
+   Miller-Rabin bases instead of a Lucas test on the factors of n - 1.  */
+#ifndef DETERMINISTIC_MR
+# define DETERMINISTIC_MR 1
+#endif
+
 #ifdef __GNUC__
 # define LIKELY(cond)    __builtin_expect ((cond), 1)
 # define UNLIKELY(cond)  __builtin_expect ((cond), 0)
@@ -93,6 +99,7 @@
 #endif
 
 #include "utils.h"
+#include "factor_cache.h"
 #include <getopt.h>
 #include <stdio.h>
 
@@ -163,9 +170,6 @@ const unsigned char factor_clz_tab[129] =
 # endif
 
 
-/* 2*3*5*7*11...*101 is 128 bits, and has 26 prime factors */
-#define MAX_NFACTS 26
-
 
 
 //static void factor (uintmax_t, uintmax_t, struct factors *);
@@ -365,29 +369,16 @@ gcd_odd (uint64_t a, uint64_t b)
   if (a == 0)
     return b;
 
-  /* Take out least significant one bit, to make room for sign */
-  b >>= 1;
-
+  /* Binary gcd, a whole run of zero bits at a time and no branch on which
+     operand is larger.  */
+  a >>= __builtin_ctzll (a);
   for (;;)
     {
-      uint64_t t;
-      uint64_t bgta;
-
-      while ((a & 1) == 0)
-        a >>= 1;
-      a >>= 1;
-
-      t = a - b;
-      if (t == 0)
-        return (a << 1) + 1;
-
-      bgta = HIGHBIT_TO_MASK (t);
-
-      /* b <-- min (a, b) */
-      b += (bgta & t);
-
-      /* a <-- |a - b| */
-      a = (t ^ bgta) - bgta;
+      const uint64_t lo = std::min (a, b), d = std::max (a, b) - lo;
+      if (d == 0)
+        return lo;
+      a = lo;
+      b = d >> __builtin_ctzll (d);
     }
 }
 
@@ -651,6 +642,39 @@ factor_using_division (uint64_t *t1p, uint64_t t1, uint64_t t0,
   return t0;
 }
 
+/* factor_using_division for a single word T0 > 0: only the 8-way loop.  */
+static uint64_t
+factor_using_division1 (uint64_t t0, struct factors *factors)
+{
+  if (t0 % 2 == 0)
+    {
+      const unsigned int cnt = __builtin_ctzll (t0);
+      t0 >>= cnt;
+      factor_insert_multiplicity (factors, 2, cnt);
+    }
+
+  uint64_t p = 3;
+  for (unsigned int i = 0; i < PRIMES_PTAB_ENTRIES; i += 8)
+    {
+      uint64_t q;
+      const struct primes_dtab *pd = &primes_dtab[i];
+      DIVBLOCK (0);
+      DIVBLOCK (1);
+      DIVBLOCK (2);
+      DIVBLOCK (3);
+      DIVBLOCK (4);
+      DIVBLOCK (5);
+      DIVBLOCK (6);
+      DIVBLOCK (7);
+
+      p += primes_diff8[i];
+      if (p * p > t0)
+        break;
+    }
+
+  return t0;
+}
+
 /* Entry i contains (2i+1)^(-1) mod 2^8.  */
 static const unsigned char  binvert_table[128] =
 {
@@ -948,8 +972,22 @@ millerrabin2 (const uint64_t *np, uint64_t ni, const uint64_t *bp,
   return false;
 }
 
+#if DETERMINISTIC_MR
+/* No composite below 2^64 is a strong pseudoprime to all of these bases
+   (Jim Sinclair's set), so passing them is a proof.  */
+static const uint64_t mr_bases_64[] =
+  { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+
+/* The same below 7999252175582851 > 2^52, with five bases.  */
+static const uint64_t mr_bases_52[] =
+  { 2, 4130806001517, 149795463772692060, 186635894390467037,
+    3967304179347715805 };
+#endif
+
 /* Lucas' prime test.  The number of iterations vary greatly, up to a few dozen
-   have been observed.  The average seem to be about 2.  */
+   have been observed.  The average seem to be about 2.  BITS bounds n, and
+   picks the Miller-Rabin bases.  */
+template <unsigned int BITS = 64>
 static bool
 prime_p (uint64_t n)
 {
@@ -979,6 +1017,32 @@ prime_p (uint64_t n)
   if (!millerrabin (n, ni, a_prim, q, k, one))
     return false;
 
+#if DETERMINISTIC_MR
+  if (flag_prove_primality)
+    {
+      const auto &mr_bases = [] () -> const auto &
+        {
+          if constexpr (BITS <= 52)
+            return mr_bases_52;
+          else
+            return mr_bases_64;
+        } ();
+      /* B^2 mod n takes the bases to redc form with one mulredc each */
+      uint64_t one2;
+      redcify (one2, one, n);
+      for (unsigned int i = 1; i < std::size (mr_bases); i++)
+        {
+          const uint64_t b = mr_bases[i] % n;
+          if (b == 0)
+            continue;
+
+          if (!millerrabin (n, ni, mulredc (b, one2, n, ni), q, k, one))
+            return false;
+        }
+      return true;
+    }
+#endif
+
   if (flag_prove_primality)
     {
       /* Factor n-1 for Lucas.  */
@@ -1133,89 +1197,80 @@ prime2_p (uint64_t n1, uint64_t n0)
 }
 
 
+/* Brent's variant of Pollard rho.  x runs through x^2 + a in Montgomery
+   form and is compared with its value at the last power of two; the
+   differences are multiplied together and one gcd is taken per BLOCK
+   steps.  A block whose gcd is n is replayed a step at a time from its
+   start, and only when that finds n too does a change.  */
+template <unsigned int BITS = 64>
 static void
 factor_using_pollard_rho (uint64_t n, unsigned long int a,
-                          struct factors *factors)
+                          struct factors *factors,
+                          unsigned int block = rho_block_length)
 {
-  uint64_t x, z, y, P, t, ni, g;
-
-  unsigned long int k = 1;
-  unsigned long int l = 1;
-
-  redcify (P, 1, n);
-  addmod (x, P, P, n);          /* i.e., redcify(2) */
-  y = z = x;
-
+  block = std::max (block, 1u);
   while (n != 1)
     {
       assert (a < n);
 
-      binv (ni, n);             /* FIXME: when could we use old 'ni' value? */
+      uint64_t ni, one, x, y, ys, q, t, g = 1;
+      binv (ni, n);
+      redcify (one, 1, n);
+      addmod (y, one, one, n);  /* i.e., redcify(2) */
+      q = one;
 
-      for (;;)
+      for (unsigned long int r = 1; g == 1; r *= 2)
         {
-          do
+          x = y;
+          for (unsigned long int i = 0; i < r; i++)
             {
-              x = mulredc (x, x, n, ni);
-              addmod (x, x, a, n);
-
-              submod (t, z, x, n);
-              P = mulredc (P, t, n, ni);
-
-              if (k % 32 == 1)
-                {
-                  if (gcd_odd (P, n) != 1)
-                    goto factor_found;
-                  y = x;
-                }
+              y = mulredc (y, y, n, ni);
+              addmod (y, y, a, n);
             }
-          while (--k != 0);
-
-          z = x;
-          k = l;
-          l = 2 * l;
-          for (unsigned long int i = 0; i < k; i++)
+          for (unsigned long int k = 0; k < r && g == 1; k += block)
             {
-              x = mulredc (x, x, n, ni);
-              addmod (x, x, a, n);
+              ys = y;
+              const unsigned long int m = std::min<unsigned long int> (block, r - k);
+              for (unsigned long int i = 0; i < m; i++)
+                {
+                  y = mulredc (y, y, n, ni);
+                  addmod (y, y, a, n);
+                  submod (t, x, y, n);
+                  q = mulredc (q, t, n, ni);
+                }
+              g = gcd_odd (q, n);
             }
-          y = x;
         }
 
-    factor_found:
-      do
-        {
-          y = mulredc (y, y, n, ni);
-          addmod (y, y, a, n);
-
-          submod (t, z, y, n);
-          g = gcd_odd (t, n);
-        }
-      while (g == 1);
+      if (g == n)
+        do
+          {
+            ys = mulredc (ys, ys, n, ni);
+            addmod (ys, ys, a, n);
+            submod (t, x, ys, n);
+            g = gcd_odd (t, n);
+          }
+        while (g == 1);
 
-      if (n == g)
+      if (g == n)
         {
-          /* Found n itself as factor.  Restart with different params.  */
-          factor_using_pollard_rho (n, a + 1, factors);
-          return;
+          /* The sequence itself cycled mod n.  Try the next polynomial.  */
+          a++;
+          continue;
         }
 
       n = n / g;
 
-      if (!prime_p (g))
-        factor_using_pollard_rho (g, a + 1, factors);
+      if (!prime_p<BITS> (g))
+        factor_using_pollard_rho<BITS> (g, a + 1, factors, block);
       else
         factor_insert (factors, g);
 
-      if (prime_p (n))
+      if (prime_p<BITS> (n))
         {
           factor_insert (factors, n);
           break;
         }
-
-      x = x % n;
-      z = z % n;
-      y = y % n;
     }
 }
 
@@ -1341,31 +1396,245 @@ factor_using_pollard_rho2 (uint64_t n1, uint64_t n0, unsigned long int a,
 }
 
 
-/* Compute the prime factors of the 128-bit number (T1,T0), and put the
-   results in FACTORS.  */
-void factor (uint64_t t0, struct factors *factors)
+static thread_local uint64_t rho_calls;
+
+uint64_t rho_invocations ()
+{
+  return rho_calls;
+}
+
+void factor_rho (uint64_t n, struct factors *factors, unsigned int block_length)
 {
-    std::uint64_t t1 = 0;
   factors->nfactors = 0;
   factors->plarge[1] = 0;
+  factor_using_pollard_rho<64> (n, 1, factors, block_length);
+}
 
-  if (t1 == 0 && t0 < 2)
+/* What is left once the table primes are out: 1, a prime or a product of
+   primes above FIRST_OMITTED_PRIME.  */
+template <unsigned int BITS>
+static void
+factor_cofactor (uint64_t t0, struct factors *factors)
+{
+  if (t0 < 2)
     return;
 
-  t0 = factor_using_division (&t1, t1, t0, factors);
+  factor_cache *cache = factor_cache::current ();
+  if (!cache || t0 < (uint64_t) FIRST_OMITTED_PRIME * FIRST_OMITTED_PRIME)
+    {
+      if (prime_p<BITS> (t0))
+        factor_insert (factors, t0);
+      else
+        {
+          rho_calls++;
+          factor_using_pollard_rho<BITS> (t0, 1, factors);
+        }
+      return;
+    }
+
+  uint64_t primes[factor_cache::max_primes];
+  unsigned int count = cache->find (t0, primes);
+  if (count == 0)
+    {
+      struct factors split;
+      split.nfactors = 0;
+      split.plarge[1] = 0;
+      if (prime_p<BITS> (t0))
+        factor_insert (&split, t0);
+      else
+        {
+          rho_calls++;
+          factor_using_pollard_rho<BITS> (t0, 1, &split);
+        }
+
+      for (unsigned int i = 0; i < split.nfactors; i++)
+        for (unsigned int j = 0; j < split.e[i]; j++)
+          primes[count++] = split.p[i];
+      cache->insert (t0, primes, count);
+    }
+  for (unsigned int i = 0; i < count; i++)
+    factor_insert (factors, primes[i]);
+}
+
+/* Compute the prime factors of T0 < 2^BITS, and put the results in
+   FACTORS.  One word all the way: none of the two-word trial division,
+   prime2_p or factor_using_pollard_rho2 of the 128-bit code.  */
+template <unsigned int BITS>
+void factor_word (uint64_t t0, struct factors *factors)
+{
+  static_assert (BITS <= 64);
+  factors->nfactors = 0;
+  factors->plarge[1] = 0;
 
-  if (t1 == 0 && t0 < 2)
+  if (t0 < 2)
     return;
 
-  if (prime2_p (t1, t0))
-    factor_insert_large (factors, t1, t0);
+  factor_cofactor<BITS> (factor_using_division1 (t0, factors), factors);
+}
+
+template void factor_word<52> (uint64_t t0, struct factors *factors);
+template void factor_word<64> (uint64_t t0, struct factors *factors);
+
+void factor (uint64_t t0, struct factors *factors)
+{
+  if (t0 >> 52 == 0)
+    factor_word<52> (t0, factors);
+  else
+    factor_word<64> (t0, factors);
+}
+
+bool cofactor_is_prime (uint64_t n)
+{
+  return n >> 52 == 0 ? prime_p<52> (n) : prime_p<64> (n);
+}
+
+uint64_t factor_small (uint64_t t0, struct factors *factors)
+{
+  factors->nfactors = 0;
+  factors->plarge[1] = 0;
+
+  if (t0 < 2)
+    return 1;
+
+  return factor_using_division1 (t0, factors);
+}
+
+void factor_rest (uint64_t rest, struct factors *factors)
+{
+  if (rest >> 52 == 0)
+    factor_cofactor<52> (rest, factors);
   else
+    factor_cofactor<64> (rest, factors);
+}
+
+/* Trial division of a block of numbers at once.  Instead of testing the
+   table primes one by one against each number, multiply the products of
+   consecutive table primes together modulo the odd part of every number of
+   a group, BLOCK_LANES numbers in lanes so the redc chains overlap (in
+   IFMA vectors where the numbers fit in 52 bits).  The gcd of that product
+   with the number is the product of its distinct primes below
+   FIRST_OMITTED_PRIME, and a few more gcds give the whole smooth part.
+   Only the smooth part, which has just small primes, goes through
+   factor_using_division.  */
+
+#define BLOCK_LANES 16
+
+/* Products of consecutive odd table primes, each below 2^BITS.  */
+static std::vector<uint64_t>
+table_products (unsigned int bits)
+{
+  const uint64_t limit = bits == 64 ? UINT64_MAX : (uint64_t) 1 << bits;
+  std::vector<uint64_t> result;
+  uint64_t p = 3, product = 1;
+  for (unsigned int i = 0; i < PRIMES_PTAB_ENTRIES; i++)
     {
+      if (product > (limit - 1) / p)
+        {
+          result.push_back (product);
+          product = 1;
+        }
+      product *= p;
+      p += primes_diff[i + 1];
+    }
+  result.push_back (product);
+  return result;
+}
 
-      if (t1 == 0)
-        factor_using_pollard_rho (t0, 1, factors);
-      else
-        factor_using_pollard_rho2 (t1, t0, 1, factors);
+/* Set SMOOTH[i] to the part of the odd number T[i] made of table primes,
+   for the N <= BLOCK_LANES numbers of T.  */
+static void
+smooth_parts (const uint64_t *t, unsigned int n, uint64_t *smooth)
+{
+  static const std::vector<uint64_t> products64 = table_products (64);
+  static const std::vector<uint64_t> products52 = table_products (52);
+  static const bool ifma = supported (two_part_kernel::ifma);
+
+  uint64_t m[BLOCK_LANES], r[BLOCK_LANES];
+  for (unsigned int l = 0; l < BLOCK_LANES; l++)
+    m[l] = l < n ? t[l] : 1;
+
+  /* r ends as the product times a power of 2^-64 or 2^-52, which is
+     coprime to m */
+  if (ifma && *std::max_element (m, m + BLOCK_LANES) >> 52 == 0)
+    {
+      product_lanes (products52.data (), products52.size (), m, r);
+      gcd_lanes (r, m);
+    }
+  else
+    {
+      uint64_t mi[BLOCK_LANES];
+      for (unsigned int l = 0; l < BLOCK_LANES; l++)
+        {
+          binv (mi[l], m[l]);
+          r[l] = 1;
+        }
+      for (uint64_t c : products64)
+        for (unsigned int l = 0; l < BLOCK_LANES; l++)
+          {
+            const __uint128_t ab = static_cast<__uint128_t> (r[l]) * c;
+            const uint64_t q = static_cast<uint64_t> (ab) * mi[l];
+            const uint64_t h = ab >> 64;
+            const uint64_t qm = (static_cast<__uint128_t> (q) * m[l]) >> 64;
+            r[l] = h < qm ? h - qm + m[l] : h - qm;
+          }
+      for (unsigned int l = 0; l < BLOCK_LANES; l++)
+        r[l] = gcd_odd (r[l], m[l]);
+    }
+
+  /* r is the product of the distinct table primes of m */
+  for (unsigned int l = 0; l < n; l++)
+    {
+      uint64_t g = r[l], rest = m[l];
+      smooth[l] = 1;
+      while (g > 1)
+        {
+          rest /= g;
+          smooth[l] *= g;
+          g = gcd_odd (rest % g, g);
+        }
+    }
+}
+
+void factor_block_small (const uint64_t *t, std::size_t n, struct factors *factors,
+                         uint64_t *rest)
+{
+  for (std::size_t i = 0; i < n; i += BLOCK_LANES)
+    {
+      const unsigned int lanes = std::min<std::size_t> (n - i, BLOCK_LANES);
+      uint64_t odd[BLOCK_LANES], smooth[BLOCK_LANES];
+      for (unsigned int l = 0; l < lanes; l++)
+        odd[l] = t[i + l] ? t[i + l] >> __builtin_ctzll (t[i + l]) : 1;
+      smooth_parts (odd, lanes, smooth);
+
+      for (unsigned int l = 0; l < lanes; l++)
+        {
+          struct factors *f = &factors[i + l];
+          f->nfactors = 0;
+          f->plarge[1] = 0;
+          rest[i + l] = 1;
+          if (t[i + l] < 2)
+            continue;
+
+          if (odd[l] != t[i + l])
+            factor_insert_multiplicity (f, 2, __builtin_ctzll (t[i + l]));
+          /* what trial division leaves of the smooth part is 1 or a prime */
+          const uint64_t last = factor_using_division1 (smooth[l], f);
+          if (last > 1)
+            factor_insert (f, last);
+
+          rest[i + l] = odd[l] / smooth[l];
+        }
     }
 }
 
+void factor_block (const uint64_t *t, std::size_t n, struct factors *factors)
+{
+  uint64_t rest[BLOCK_LANES];
+  for (std::size_t i = 0; i < n; i += BLOCK_LANES)
+    {
+      const std::size_t lanes = std::min<std::size_t> (n - i, BLOCK_LANES);
+      factor_block_small (t + i, lanes, factors + i, rest);
+      for (std::size_t l = 0; l < lanes; l++)
+        factor_rest (rest[l], &factors[i + l]);
+    }
+}
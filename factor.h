@@ -1,12 +1,67 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/* 2*3*5*7*11...*101 is 128 bits, and has 26 prime factors */
+#define MAX_NFACTS 26
 
 struct factors
 {
   uint64_t     plarge[2];
-  uint64_t     p[26];
-  unsigned char e[26];
+  uint64_t     p[MAX_NFACTS];
+  unsigned char e[MAX_NFACTS];
   unsigned char nfactors;
 };
 
+/* Picks the narrowest factor_word instance that fits t0.  */
 void factor (std::uint64_t t0, struct factors *factors);
+
+/* The primality test factor runs on what trial division leaves: whether n,
+   with no prime factor below 5003, is prime.  */
+bool cofactor_is_prime (std::uint64_t n);
+
+/* Single-word factorisation of t0 < 2^bits; instantiated for 52 and 64.  */
+template <unsigned int bits>
+void factor_word (std::uint64_t t0, struct factors *factors);
+
+/* Iterations of Pollard rho between two gcds.  */
+constexpr unsigned int rho_block_length = 128;
+
+/* Pollard rho alone on N, odd, composite and with no prime factor below
+   5003, taking a gcd every BLOCK_LENGTH iterations (at least 1).  */
+void factor_rho (std::uint64_t n, struct factors *factors,
+                 unsigned int block_length = rho_block_length);
+
+/* Cofactors the calling thread has handed to Pollard rho so far.  */
+std::uint64_t rho_invocations ();
+
+/* Factors t[0..n) into factors[0..n), with the trial division batched.  */
+void factor_block (const std::uint64_t *t, std::size_t n, struct factors *factors);
+
+/* The first half of factor and factor_block: only trial division by the
+   table primes, which go to FACTORS.  Returns, or sets REST[i] to, what is
+   left, 1 or a number coprime to every prime found.  */
+std::uint64_t factor_small (std::uint64_t t0, struct factors *factors);
+void factor_block_small (const std::uint64_t *t, std::size_t n, struct factors *factors,
+                         std::uint64_t *rest);
+
+/* The second half: adds the primes of such a REST to FACTORS.  */
+void factor_rest (std::uint64_t rest, struct factors *factors);
+
+struct prime_power {
+    uint64_t p;
+    uint64_t e;
+};
+
+using factor_span = std::span<const prime_power>;
+
+// A factorisation held by value, with no heap allocation: the distinct primes
+// in increasing order, as factorint's map would list them.
+struct factorization {
+    prime_power f[MAX_NFACTS];
+    std::size_t count {0};
+
+    operator factor_span() const { return {f, count}; }
+};
@@ -0,0 +1,102 @@
+#include "factor_cache.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+thread_local factor_cache *installed {nullptr};
+
+}
+
+factor_cache::factor_cache(std::size_t capacity)
+    : entries(std::max<std::size_t>(capacity, 1)),
+      slots(std::bit_ceil(2 * entries.size()), none),
+      mask(slots.size() - 1) {}
+
+std::size_t factor_cache::slot(uint64_t n) const {
+    return (n * 0x9e3779b97f4a7c15ull) >> 32 & mask;
+}
+
+// The slot holding n, or the empty slot where it would go.
+std::size_t factor_cache::lookup(uint64_t n) const {
+    auto i = slot(n);
+    while(slots[i] != none && entries[slots[i]].n != n) i = (i + 1) & mask;
+    return i;
+}
+
+// Linear probing deletion: pull later members of the cluster back over the
+// hole as long as that keeps them reachable from their home slot.
+void factor_cache::erase_slot(std::size_t i) {
+    for(auto j = (i + 1) & mask; slots[j] != none; j = (j + 1) & mask) {
+        const auto home = slot(entries[slots[j]].n);
+        if(((j - home) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i] = none;
+}
+
+void factor_cache::unlink(uint32_t e) {
+    auto &x = entries[e];
+    (x.prev == none ? head : entries[x.prev].next) = x.next;
+    (x.next == none ? tail : entries[x.next].prev) = x.prev;
+}
+
+void factor_cache::push_front(uint32_t e) {
+    entries[e].prev = none;
+    entries[e].next = head;
+    (head == none ? tail : entries[head].prev) = e;
+    head = e;
+}
+
+unsigned factor_cache::find(uint64_t n, uint64_t *primes) {
+    const auto i = lookup(n);
+    if(slots[i] == none) {
+        ++n_misses;
+        return 0;
+    }
+    ++n_hits;
+    const auto e = slots[i];
+    if(e != head) {
+        unlink(e);
+        push_front(e);
+    }
+    std::copy_n(entries[e].primes, entries[e].count, primes);
+    return entries[e].count;
+}
+
+void factor_cache::insert(uint64_t n, const uint64_t *primes, unsigned count) {
+    if(count == 0 || count > max_primes) return;
+    auto i = lookup(n);
+    if(slots[i] != none) return;
+
+    uint32_t e;
+    if(n_entries < entries.size()) {
+        e = n_entries++;
+    }
+    else {
+        e = tail;
+        unlink(e);
+        erase_slot(lookup(entries[e].n));
+        i = lookup(n);
+    }
+    entries[e].n = n;
+    entries[e].count = count;
+    std::copy_n(primes, count, entries[e].primes);
+    slots[i] = e;
+    push_front(e);
+}
+
+factor_cache *factor_cache::current() {
+    return installed;
+}
+
+factor_cache::scope::scope(factor_cache &cache) : previous(installed) {
+    installed = &cache;
+}
+
+factor_cache::scope::~scope() {
+    installed = previous;
+}
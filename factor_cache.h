@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LRU memo of the cofactors factor() is left with after trial division:
+// numbers with no prime below 5003, which only Miller-Rabin and Pollard rho
+// can split. A cache serves one thread; factor() consults the one installed
+// with factor_cache::scope, and runs without a memo when there is none.
+// Fixed capacity, so nothing is allocated once it is built.
+class factor_cache {
+public:
+    static constexpr unsigned max_primes {5}; // 5003^5 < 2^64 < 5003^6
+
+    explicit factor_cache(std::size_t capacity);
+
+    // Copies the primes of n, with repetition, to primes and returns how
+    // many there are, or 0 when n is not cached.
+    unsigned find(uint64_t n, uint64_t *primes);
+
+    // Caches the count primes of n, evicting the least recently used entry
+    // when full.
+    void insert(uint64_t n, const uint64_t *primes, unsigned count);
+
+    uint64_t hits() const { return n_hits; }
+    uint64_t misses() const { return n_misses; }
+    std::size_t size() const { return n_entries; }
+
+    // The calling thread's cache, or nullptr.
+    static factor_cache *current();
+
+    // Installs a cache for the calling thread while in scope.
+    class scope {
+    public:
+        explicit scope(factor_cache &cache);
+        ~scope();
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+
+    private:
+        factor_cache *previous;
+    };
+
+private:
+    static constexpr uint32_t none {UINT32_MAX};
+
+    struct entry {
+        uint64_t n;
+        uint64_t primes[max_primes];
+        uint32_t count;
+        uint32_t prev;  // towards the most recently used
+        uint32_t next;
+    };
+
+    std::size_t slot(uint64_t n) const;
+    std::size_t lookup(uint64_t n) const;
+    void erase_slot(std::size_t i);
+    void unlink(uint32_t e);
+    void push_front(uint32_t e);
+
+    std::vector<entry> entries;
+    std::vector<uint32_t> slots; // open addressing on n, entry index or none
+    std::size_t mask;
+    std::size_t n_entries {0};
+    uint32_t head {none};
+    uint32_t tail {none};
+    uint64_t n_hits {0};
+    uint64_t n_misses {0};
+};
@@ -0,0 +1,71 @@
+#include "factor_sieve.h"
+
+#include <algorithm>
+#include <bit>
+
+// Slot i of a segment starting at the even number low stands for low + 2i.
+factor_sieve::factor_sieve(const std::vector<unsigned> &primes, uint64_t min, uint64_t max,
+                           std::size_t segment)
+    : product(segment), head(segment), low(min & ~uint64_t{1}), high(max)
+{
+    for(auto p : primes) {
+        if(p == 2) continue;
+        if(static_cast<__uint128_t>(p) * p >= max) break;
+
+        // the powers of p run right after p itself, so their entry is always
+        // at the head of the slot's list when they reach it
+        for(uint64_t q = p; q <= (max - 1) / 2; q = q > UINT64_MAX / p ? UINT64_MAX : q * p) {
+            const uint64_t r = low % (2 * q);
+            powers.push_back({q, r ? (2 * q - r) / 2 : 0, p, q == p});
+        }
+    }
+    entries.reserve(4 * segment);
+}
+
+void factor_sieve::fill() {
+    n_slots = std::min<uint64_t>(product.size(), (high - low + 1) / 2);
+    std::fill_n(product.begin(), n_slots, 1);
+    std::fill_n(head.begin(), n_slots, none);
+    entries.clear();
+
+    for(auto &s : powers) {
+        uint64_t i = s.offset;
+        if(s.first) {
+            for(; i < n_slots; i += s.step) {
+                entries.push_back({s.prime, 1, head[i]});
+                head[i] = entries.size() - 1;
+                product[i] *= s.prime;
+            }
+        }
+        else {
+            for(; i < n_slots; i += s.step) {
+                ++entries[head[i]].exponent;
+                product[i] *= s.prime;
+            }
+        }
+        s.offset = i - n_slots;
+    }
+}
+
+factorization factor_sieve::factorize(uint64_t n) {
+    while(n >= low + 2 * n_slots) {
+        low += 2 * n_slots;
+        fill();
+    }
+    const std::size_t i = (n - low) / 2;
+
+    factorization result;
+    const unsigned twos = std::countr_zero(n);
+    if(twos) result.f[result.count++] = {2, twos};
+
+    // the list runs from the largest prime down
+    const auto odd = result.count;
+    for(auto e = head[i]; e != none; e = entries[e].next) {
+        result.f[result.count++] = {entries[e].prime, entries[e].exponent};
+    }
+    std::reverse(result.f + odd, result.f + result.count);
+
+    const uint64_t rest = (n >> twos) / product[i];
+    if(rest > 1) result.f[result.count++] = {rest, 1};
+    return result;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "factor.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Factorisations of the even numbers in [min, max) as a byproduct of sieving,
+// for p - 1 over a window of primes p. Every odd prime q with q*q < max and
+// each of its powers walk their multiples segment by segment, like the prime
+// sieve, leaving a list of (q, e) and the product of the q^e in every slot.
+// What remains once those are divided out is 1 or a single prime above
+// sqrt(max), so nothing is trial divided or handed to Pollard rho.
+class factor_sieve {
+public:
+    static constexpr std::size_t default_segment {1 << 14}; // even numbers per segment
+
+    factor_sieve(const std::vector<unsigned> &primes, uint64_t min, uint64_t max,
+                 std::size_t segment = default_segment);
+
+    // The factorisation of the even number n in [min, max). Successive calls
+    // must not go back to an earlier segment.
+    factorization factorize(uint64_t n);
+
+private:
+    void fill();
+
+    struct power {
+        uint64_t step;   // q^e, the distance between its even multiples in slots
+        uint64_t offset; // slot of the next multiple
+        unsigned prime;
+        bool first;      // e == 1, starts a new entry
+    };
+    struct entry {
+        unsigned prime;
+        unsigned exponent;
+        uint32_t next;
+    };
+    static constexpr uint32_t none {UINT32_MAX};
+
+    std::vector<power> powers;
+    std::vector<uint64_t> product;
+    std::vector<uint32_t> head;
+    std::vector<entry> entries;
+    uint64_t low;
+    uint64_t high;
+    std::size_t n_slots {0};
+};
@@ -0,0 +1,130 @@
+#include "journal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+std::runtime_error journal_error(const std::string &path, const std::string &what) {
+    return std::runtime_error(path + ": " + what);
+}
+
+void write_all(int fd, const std::string &data) {
+    for(std::size_t written = 0; written != data.size();) {
+        const auto n = ::write(fd, data.data() + written, data.size() - written);
+        if(n < 0 && errno != EINTR) throw std::runtime_error(std::strerror(errno));
+        if(n > 0) written += n;
+    }
+    if(::fsync(fd) != 0) throw std::runtime_error(std::strerror(errno));
+}
+
+}
+
+progress_journal::progress_journal(const std::string &path, uint64_t min, uint64_t max,
+                                   uint64_t block, bool resume)
+    : start(min), end(max), block_size(block),
+      completed(max > min ? (max - min - 1) / block + 1 : 0)
+{
+    if(resume) {
+        fd = ::open(path.c_str(), O_RDWR | O_APPEND);
+        if(fd < 0) throw journal_error(path, std::strerror(errno));
+        load(path);
+    }
+    else {
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_EXCL, 0644);
+        if(fd < 0 && errno == EEXIST) throw journal_error(path, "journal exists, pass --resume to continue it");
+        if(fd < 0) throw journal_error(path, std::strerror(errno));
+        std::ostringstream header;
+        header << "ord23 " << start << ' ' << end << ' ' << block_size << '\n';
+        write_all(fd, header.str());
+    }
+}
+
+progress_journal::~progress_journal() {
+    if(fd >= 0) ::close(fd);
+}
+
+void progress_journal::load(const std::string &path) {
+    std::string data;
+    char buffer[1 << 16];
+    for(ssize_t n; (n = ::pread(fd, buffer, sizeof buffer, data.size())) != 0;) {
+        if(n < 0 && errno != EINTR) throw journal_error(path, std::strerror(errno));
+        if(n > 0) data.append(buffer, n);
+    }
+
+    // A crash in the middle of a write leaves a torn last line, which is
+    // dropped once the complete lines before it have been read.
+    const auto size = data.size();
+    data.resize(data.rfind('\n') + 1);
+
+    std::istringstream lines(data);
+    std::string kind;
+    uint64_t a, b, c;
+    if(!(lines >> kind >> a >> b >> c) || kind != "ord23")
+        throw journal_error(path, "not an ord23 journal");
+    if(a != start || b != end || c != block_size)
+        throw journal_error(path, "journal is for a different range or block size");
+
+    std::vector<std::pair<uint64_t, uint64_t>> block_hits;
+    while(lines >> kind >> a) {
+        if(kind == "hit" && lines >> b) block_hits.emplace_back(a, b);
+        else if(kind == "done" && a < completed.size()) completed[a] = true;
+        else throw journal_error(path, "malformed record");
+    }
+    for(const auto &[block, p] : block_hits) {
+        if(block < completed.size() && completed[block]) found.push_back(p);
+    }
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    // new records must start on a line of their own
+    if(data.size() != size && ::ftruncate(fd, data.size()) != 0)
+        throw journal_error(path, std::strerror(errno));
+}
+
+void progress_journal::complete(uint64_t block, const std::vector<uint64_t> &block_hits) {
+    std::ostringstream record;
+    for(auto p : block_hits) record << "hit " << block << ' ' << p << '\n';
+    record << "done " << block << '\n';
+
+    std::lock_guard guard(lock);
+    write_all(fd, record.str());
+    completed[block] = true;
+    found.insert(found.end(), block_hits.begin(), block_hits.end());
+}
+
+bool progress_journal::done(uint64_t block) const {
+    std::lock_guard guard(lock);
+    return completed[block];
+}
+
+std::vector<uint64_t> progress_journal::pending() const {
+    std::lock_guard guard(lock);
+    std::vector<uint64_t> blocks;
+    for(uint64_t b = 0; b != completed.size(); ++b) {
+        if(!completed[b]) blocks.push_back(b);
+    }
+    return blocks;
+}
+
+uint64_t progress_journal::frontier() const {
+    std::lock_guard guard(lock);
+    return std::find(completed.begin(), completed.end(), false) - completed.begin();
+}
+
+uint64_t progress_journal::completed_blocks() const {
+    std::lock_guard guard(lock);
+    return static_cast<uint64_t>(std::count(completed.begin(), completed.end(), true));
+}
+
+std::vector<uint64_t> progress_journal::hits() const {
+    std::lock_guard guard(lock);
+    auto sorted = found;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+}
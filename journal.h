@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Append-only log of the finished blocks of a search and the hits found in
+// them. A block and its hits go out in a single write() followed by fsync(),
+// so after a crash the journal holds either the whole block or none of it.
+// Blocks may complete in any order.
+//
+//     ord23 <start> <end> <block size>
+//     hit <block> <p>
+//     done <block>
+class progress_journal {
+public:
+    // Creates a new journal at path, or with resume, reopens the one there and
+    // checks that it describes the same search. Throws std::runtime_error.
+    progress_journal(const std::string &path, uint64_t min, uint64_t max,
+                     uint64_t block, bool resume);
+    ~progress_journal();
+
+    progress_journal(const progress_journal &) = delete;
+    progress_journal &operator=(const progress_journal &) = delete;
+
+    // Durably records block as finished together with its hits.
+    void complete(uint64_t block, const std::vector<uint64_t> &block_hits);
+
+    bool done(uint64_t block) const;
+
+    // Blocks that are not finished yet, in increasing order.
+    std::vector<uint64_t> pending() const;
+
+    // First block that is not finished yet; every block before it is done.
+    uint64_t frontier() const;
+
+    // Number of finished blocks.
+    uint64_t completed_blocks() const;
+
+    // Hits of the finished blocks, sorted.
+    std::vector<uint64_t> hits() const;
+
+private:
+    void load(const std::string &path);
+
+    int fd {-1};
+    uint64_t start;
+    uint64_t end;
+    uint64_t block_size;
+    mutable std::mutex lock;
+    std::vector<bool> completed;
+    std::vector<uint64_t> found;
+};
@@ -1,52 +1,117 @@
 #include "utils.h"
+#include "journal.h"
+#include "metrics.h"
+#include "options.h"
+#include "output.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "telemetry.h"
 #include "rang.hpp"
-#include <mutex>
-#include <atomic>
+#include <fstream>
+#include <memory>
 #include <thread>
 
-std::atomic<int> finished_threads {0};
-std::mutex counter;
-
-void thread(const std::vector<uint64_t> &batch) {
-    for(auto p : batch) {
-        if(coprime_orders(p)) {
-            std::cout << '\n'
-                      << rang::fgB::red
-                      << p
-                      << rang::fg::reset
-                      << std::flush;
+std::vector<uint64_t> thread(const std::vector<unsigned> &primes, uint64_t min, uint64_t max, modular_engine engine,
+                             output_channel &out, uint64_t block, telemetry &stats, unsigned worker) {
+    const auto rho = rho_invocations();
+    const auto exps = exponentiations;
+    segmented_sieve sieve(primes, min, max);
+    coprime_pipeline pipeline(nullptr, best_two_part_kernel(), engine);
+    std::vector<uint64_t> segment;
+    std::vector<uint64_t> hits;
+    while(sieve.next(segment)) {
+        segment.resize(pipeline.run(segment));
+        for(auto p : segment) {
+            out.hit(p, block);
+            hits.push_back(p);
         }
+        segment.clear();
     }
-    std::cout << "." << std::flush;
-    counter.lock();
-    ++finished_threads;
-    counter.unlock();
+    out.block_done(block);
+    stats.add(worker, telemetry::block_totals(max - min, pipeline.counts(), hits.size(), rho_invocations() - rho,
+                                              exponentiations - exps));
+    return hits;
 }
         
-int main() {
-    const constexpr uint64_t ten13halves {3'162'277}; // sqrt(10^13)
-    const constexpr uint64_t ten13 {10'000'000'000'000};
-    const constexpr uint64_t batch_size {1'000'000'000};
+int main(int argc, char *argv[]) {
+    options opts;
+    try {
+        opts = parse_options(argc, argv);
+        if(opts.help) {
+            std::cout << usage;
+            return 0;
+        }
+    }
+    catch(const std::exception &e) {
+        std::cerr << "ord23: " << e.what() << '\n' << usage;
+        return 1;
+    }
 
-    const constexpr int n_threads {4};
+    // everything that can fail comes before the journal, which would refuse
+    // the next run of a search that never started
+    std::ofstream file;
+    if(!opts.output.empty()) {
+        file.open(opts.output, std::ios::app);
+        if(!file) {
+            std::cerr << "ord23: cannot open " << opts.output << '\n';
+            return 1;
+        }
+    }
+    std::unique_ptr<metrics_exporter> exporter;
+    if(!opts.metrics.empty() || opts.metrics_port) {
+        try {
+            exporter = std::make_unique<metrics_exporter>(opts.metrics, opts.metrics_port, std::chrono::seconds(10));
+        }
+        catch(const std::runtime_error &e) {
+            std::cerr << "ord23: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    const auto primes = base_primes(opts.end); // all the primes up to sqrt(end)
+    const auto engine = fastest_engine(opts.end);
+
+    std::unique_ptr<progress_journal> journal;
+    try {
+        journal = std::make_unique<progress_journal>(opts.journal, opts.start, opts.end, opts.block, opts.resume);
+    }
+    catch(const std::exception &e) {
+        std::cerr << "ord23: " << e.what() << '\n';
+        return 1;
+    }
+    if(!opts.color) rang::setControlMode(rang::control::Off);
+    output_channel out(std::cout, file.is_open() ? &file : nullptr, opts.json);
+    for(auto p : journal->hits()) out.replay(p, (p - opts.start) / opts.block);
 
-    std::vector<unsigned> primes; // all the primes less than 10^6.5
+    const auto pending = journal->pending();
+    const auto n_threads = std::clamp<uint64_t>(opts.threads ? opts.threads : std::thread::hardware_concurrency(),
+                                                1, std::max<uint64_t>(pending.size(), 1));
 
-    for(unsigned n = 2; n != ten13halves; ++n) {
-		if(std::all_of(primes.begin(), primes.end(), [&](int i) {return n % i != 0;})) {
-			primes.push_back(n);
-		}
-	}
+    const auto bounds = [&](uint64_t block) {
+        const auto min = opts.start + block * opts.block;
+        return std::pair{min, opts.end - min > opts.block ? min + opts.block : opts.end};
+    };
+    uint64_t remaining {0};
+    for(auto block : pending) remaining += bounds(block).second - bounds(block).first;
+    telemetry stats(n_threads, opts.end - opts.start, remaining);
 
-    std::vector<std::thread> threads;
+    const uint64_t n_blocks = (opts.end - opts.start - 1) / opts.block + 1;
+    const auto render = [&] {
+        const auto frontier = journal->frontier();
+        return prometheus_metrics(stats, {frontier == n_blocks ? opts.end : opts.start + frontier * opts.block,
+                                          opts.end, journal->completed_blocks(), n_blocks, journal->hits().size()});
+    };
 
-    for(uint64_t n = 0; n != 10'000; ++n) {
-        while(n - finished_threads > n_threads) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10'000));
-        }
-        auto vector = batch(primes, n * batch_size, (n + 1) * batch_size);
-        std::thread t(thread, vector);
-        threads.push_back(std::move(t));
+    {
+        std::unique_ptr<status_reporter> reporter;
+        if(opts.status) reporter = std::make_unique<status_reporter>(stats, std::cerr, std::chrono::seconds(opts.status));
+        if(exporter) exporter->start(render);
+        run_blocks(pending.size(), n_threads, [&](unsigned worker, uint64_t i) {
+            const auto block = pending[i];
+            const auto [min, max] = bounds(block);
+            journal->complete(block, thread(primes, min, max, engine, out, block, stats, worker));
+        });
+        if(exporter) exporter->stop(); // the last render needs the journal and stats
     }
+    if(opts.status) std::cerr << stats.summary();
     return 0;
 }
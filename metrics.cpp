@@ -0,0 +1,175 @@
+#include "metrics.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+template<typename T>
+void metric(std::ostream &out, const char *name, const char *type, const char *help, T value) {
+    out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n' << name << ' ' << value << '\n';
+}
+
+void send_all(int fd, const std::string &text) {
+    for(std::size_t sent = 0; sent < text.size();) {
+        const auto n = ::send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return;
+        sent += static_cast<std::size_t>(n);
+    }
+}
+
+}
+
+std::string prometheus_metrics(const telemetry &stats, const search_progress &progress) {
+    const auto t = stats.sum();
+    const double seconds = stats.elapsed();
+    std::ostringstream out;
+    out.precision(9);
+
+    metric(out, "ord23_frontier", "gauge", "Every number below it is searched.", progress.frontier);
+    metric(out, "ord23_end", "gauge", "The search stops below this number.", progress.end);
+    metric(out, "ord23_blocks", "gauge", "Blocks in the whole search.", progress.blocks);
+    metric(out, "ord23_blocks_completed", "gauge", "Blocks recorded as finished in the journal.",
+           progress.completed_blocks);
+    metric(out, "ord23_hits", "gauge", "Primes found with coprime orders of 2 and 3.", progress.hits);
+    metric(out, "ord23_numbers_total", "counter", "Numbers searched by this process.", t.numbers);
+    metric(out, "ord23_primes_total", "counter", "Primes found by the sieve.", t.primes);
+    metric(out, "ord23_candidates_total", "counter", "Primes whose p - 1 had to be factored.", t.candidates);
+    metric(out, "ord23_candidates_per_second", "gauge", "Candidates per second since the process started.",
+           seconds > 0 ? t.candidates / seconds : 0);
+    metric(out, "ord23_rho_total", "counter", "Cofactors given to Pollard rho.", t.rho);
+    metric(out, "ord23_exponentiations_total", "counter", "Modular exponentiations.", t.exponentiations);
+
+    out << "# HELP ord23_stage_seconds Time a pipeline stage spends on one block.\n"
+           "# TYPE ord23_stage_seconds histogram\n";
+    const auto latency = stats.stage_latency();
+    for(int stage = 0; stage != 4; ++stage) {
+        const std::string label = std::string("stage=\"") + telemetry::stage_names[stage] + '"';
+        uint64_t blocks {0};
+        for(std::size_t b = 0; b != telemetry::n_buckets; ++b) {
+            blocks += latency[stage][b];
+            out << "ord23_stage_seconds_bucket{" << label << ",le=\"";
+            if(b + 1 == telemetry::n_buckets) out << "+Inf";
+            else out << telemetry::latency_bounds[b];
+            out << "\"} " << blocks << '\n';
+        }
+        out << "ord23_stage_seconds_sum{" << label << "} " << t.stage_ns[stage] * 1e-9 << '\n'
+            << "ord23_stage_seconds_count{" << label << "} " << blocks << '\n';
+    }
+
+    metric(out, "process_resident_memory_bytes", "gauge", "Resident memory size in bytes.", resident_bytes());
+    return out.str();
+}
+
+uint64_t resident_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size {0}, resident {0};
+    if(!(statm >> size >> resident)) return 0;
+    return resident * static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+}
+
+void write_atomically(const std::string &path, const std::string &text) {
+    const auto temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        if(!(file << text) || !file.flush()) throw std::runtime_error("cannot write " + temporary);
+    }
+    if(std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("cannot rename " + temporary + ": " + std::strerror(errno));
+    }
+}
+
+metrics_exporter::metrics_exporter(const std::string &file, unsigned port, std::chrono::seconds interval)
+    : path(file), period(interval) {
+    if(!path.empty()) {
+        const auto temporary = path + ".tmp";
+        if(!std::ofstream(temporary)) throw std::runtime_error("cannot write " + temporary);
+        std::remove(temporary.c_str());
+    }
+    if(port) {
+        const auto fail = [port] {
+            throw std::runtime_error("cannot serve metrics on port " + std::to_string(port) + ": "
+                                     + std::strerror(errno));
+        };
+        listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(listener < 0) fail();
+        const int on {1};
+        ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof address) != 0
+           || ::listen(listener, 8) != 0) {
+            const int error = errno;
+            ::close(listener);
+            errno = error;
+            fail();
+        }
+    }
+}
+
+metrics_exporter::~metrics_exporter() {
+    stop();
+    if(listener >= 0) ::close(listener);
+}
+
+void metrics_exporter::start(std::function<std::string()> renderer) {
+    render = std::move(renderer);
+    exporter = std::thread([this] {serve();});
+}
+
+void metrics_exporter::stop() {
+    if(!exporter.joinable()) return;
+    stopping = true;
+    exporter.join();
+    write();
+}
+
+void metrics_exporter::write() const {
+    if(path.empty()) return;
+    try {
+        write_atomically(path, render());
+    }
+    catch(const std::runtime_error &e) {
+        std::cerr << "ord23: metrics: " << e.what() << '\n';
+    }
+}
+
+// Polls in short steps so the destructor never waits long for the thread.
+void metrics_exporter::serve() {
+    using namespace std::chrono_literals;
+    auto next = std::chrono::steady_clock::now();
+    while(!stopping) {
+        if(std::chrono::steady_clock::now() >= next) {
+            write();
+            next += period;
+        }
+        pollfd ready {listener, POLLIN, 0};
+        if(::poll(&ready, listener >= 0 ? 1 : 0, 250) <= 0 || !(ready.revents & POLLIN)) continue;
+
+        const int client = ::accept(listener, nullptr, nullptr);
+        if(client < 0) continue;
+        const timeval timeout {1, 0};
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+        char request[4096];
+        const auto n = ::recv(client, request, sizeof request, 0);
+        if(n > 0) {
+            const auto body = render();
+            send_all(client, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                             + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+        }
+        ::close(client);
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "telemetry.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Where a search stands, as the journal has it.
+struct search_progress {
+    uint64_t frontier;        // every number below it is searched
+    uint64_t end;
+    uint64_t completed_blocks;
+    uint64_t blocks;
+    uint64_t hits;
+};
+
+// The Prometheus text exposition of a search: its progress, the telemetry
+// counters, a histogram of the time every stage takes per block, and the
+// resident memory of the process.
+std::string prometheus_metrics(const telemetry &stats, const search_progress &progress);
+
+// Resident set size in bytes, 0 where /proc is missing.
+uint64_t resident_bytes();
+
+// Replaces path with text through a temporary file and rename(), so readers
+// such as node_exporter's textfile collector never see half a file. Throws
+// std::runtime_error.
+void write_atomically(const std::string &path, const std::string &text);
+
+// Renders the metrics every period into a file and, with a port, serves them
+// to GET requests on 127.0.0.1 from its own thread, from start() until
+// stop(), when the file is written a last time.
+class metrics_exporter {
+public:
+    // Checks that the file can be written and binds the port, so a search
+    // fails before it starts. Throws std::runtime_error.
+    metrics_exporter(const std::string &path, unsigned port, std::chrono::seconds period);
+    ~metrics_exporter();
+
+    metrics_exporter(const metrics_exporter &) = delete;
+    metrics_exporter &operator=(const metrics_exporter &) = delete;
+
+    void start(std::function<std::string()> render);
+
+    // Also done by the destructor.
+    void stop();
+
+private:
+    void serve();
+    void write() const;
+
+    std::function<std::string()> render;
+    std::string path;
+    std::chrono::seconds period;
+    int listener {-1};
+    std::atomic<bool> stopping {false};
+    std::thread exporter;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+
+// Arithmetic modulo n behind one interface, so the order computations are
+// written once and run with any of them: residues in some internal form,
+// to() and from() convert, one is 1 in that form, and add, mul and pow work
+// on it. montgomery.h has the Montgomery form; the ones here keep plain
+// residues and differ in how they reduce a 128-bit product.
+template <typename M>
+concept modular_arithmetic = std::constructible_from<M, uint64_t> && requires(const M &m, uint64_t a, uint64_t &r) {
+    { m.n } -> std::convertible_to<uint64_t>;
+    { m.one } -> std::convertible_to<uint64_t>;
+    { m.add(a, a) } -> std::same_as<uint64_t>;
+    { m.mul(a, a) } -> std::same_as<uint64_t>;
+    { m.pow(a, a) } -> std::same_as<uint64_t>;
+    m.pow(a, a, a, r, r);
+    { m.to(a) } -> std::same_as<uint64_t>;
+    { m.from(a) } -> std::same_as<uint64_t>;
+};
+
+// Exponentiations the calling thread has done through modular_powers (a
+// pair counts two), for telemetry.
+inline thread_local uint64_t exponentiations {0};
+
+// pow on top of M's mul.
+template <typename M>
+struct modular_powers {
+    // base^exponent, both base and result in M's form. Right to left, so the
+    // multiplications into the result overlap with the squarings.
+    uint64_t pow(uint64_t base, uint64_t exponent) const {
+        const auto &m = static_cast<const M &>(*this);
+        ++exponentiations;
+        uint64_t result = m.one;
+        while(exponent > 0) {
+            if(exponent & 1) result = m.mul(result, base);
+            base = m.mul(base, base);
+            exponent >>= 1;
+        }
+        return result;
+    }
+
+    // a^exponent and b^exponent in one pass; the two chains run interleaved.
+    void pow(uint64_t a, uint64_t b, uint64_t exponent, uint64_t &ra, uint64_t &rb) const {
+        const auto &m = static_cast<const M &>(*this);
+        exponentiations += 2;
+        ra = rb = m.one;
+        while(exponent > 0) {
+            if(exponent & 1) {
+                ra = m.mul(ra, a);
+                rb = m.mul(rb, b);
+            }
+            a = m.mul(a, a);
+            b = m.mul(b, b);
+            exponent >>= 1;
+        }
+    }
+};
+
+// Plain residues: everything but mul is shared.
+template <typename M>
+struct plain_residues : modular_powers<M> {
+    uint64_t n;
+    uint64_t one {1};
+
+    explicit plain_residues(uint64_t modulus) : n(modulus) {}
+
+    uint64_t add(uint64_t a, uint64_t b) const {
+        const uint64_t s = a + b;
+        return (s < a || s >= n) ? s - n : s;
+    }
+
+    uint64_t to(uint64_t x) const { return x % n; }
+    uint64_t from(uint64_t x) const { return x; }
+};
+
+// Barrett reduction with mu = floor((2^128 - 1) / n): the quotient of a
+// product x is the high half of x * mu, less the low partial product,
+// which leaves it at most three short.
+struct barrett : plain_residues<barrett> {
+    uint64_t mu_high;
+    uint64_t mu_low;
+
+    explicit barrett(uint64_t modulus) : plain_residues(modulus) {
+        const __uint128_t mu = ~__uint128_t{0} / modulus;
+        mu_high = mu >> 64;
+        mu_low = static_cast<uint64_t>(mu);
+    }
+
+    uint64_t mul(uint64_t a, uint64_t b) const {
+        const __uint128_t x = static_cast<__uint128_t>(a) * b;
+        const uint64_t xh = x >> 64, xl = static_cast<uint64_t>(x);
+        const __uint128_t t1 = static_cast<__uint128_t>(xl) * mu_high;
+        const __uint128_t t2 = static_cast<__uint128_t>(xh) * mu_low;
+        const __uint128_t mid = (t1 & UINT64_MAX) + (t2 & UINT64_MAX);
+        const uint64_t q = static_cast<__uint128_t>(xh) * mu_high + (t1 >> 64) + (t2 >> 64) + (mid >> 64);
+        __uint128_t r = x - static_cast<__uint128_t>(q) * n;
+        while(r >= n) r -= n;
+        return static_cast<uint64_t>(r);
+    }
+};
+
+// The compiler's 128 by 64-bit remainder, a library call.
+struct int128_remainder : plain_residues<int128_remainder> {
+    using plain_residues::plain_residues;
+
+    uint64_t mul(uint64_t a, uint64_t b) const {
+        return static_cast<__uint128_t>(a) * b % n;
+    }
+};
+
+// mulq then divq, as utils.cpp's mulmod.
+struct divq_remainder : plain_residues<divq_remainder> {
+    using plain_residues::plain_residues;
+
+    uint64_t mul(uint64_t a, uint64_t b) const {
+        uint64_t r;
+        __asm__("mulq %2\n\t"
+                "divq %3"
+                : "=&d"(r), "+%a"(a)
+                : "rm"(b), "rm"(n)
+                : "cc");
+        return r;
+    }
+};
+
+// The quotient from a long double product, off by at most one, and the
+// remainder from the low 64 bits of a * b - q * n. Needs n < 2^62.
+struct float_quotient : plain_residues<float_quotient> {
+    static constexpr uint64_t limit {uint64_t{1} << 62};
+    long double inverse;
+
+    explicit float_quotient(uint64_t modulus) : plain_residues(modulus), inverse(1.0L / modulus) {}
+
+    uint64_t mul(uint64_t a, uint64_t b) const {
+        const auto q = static_cast<uint64_t>(inverse * a * b);
+        const auto r = static_cast<int64_t>(a * b - q * n);
+        return r < 0 ? r + n : static_cast<uint64_t>(r) >= n ? r - n : r;
+    }
+};
+
+static_assert(modular_arithmetic<barrett> && modular_arithmetic<int128_remainder>
+              && modular_arithmetic<divq_remainder> && modular_arithmetic<float_quotient>);
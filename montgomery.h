@@ -0,0 +1,47 @@
+#pragma once
+
+#include "modular.h"
+#include <cstdint>
+
+// Arithmetic modulo an odd n with residues kept in Montgomery form x * 2^64 mod n,
+// as in factor.cpp's mulredc. Setting up the form costs one division, for
+// 2^64 mod n; multiplications and powers afterwards use none.
+struct montgomery : modular_powers<montgomery> {
+    uint64_t n;
+    uint64_t ni;  // n^-1 mod 2^64
+    uint64_t one; // 1 in Montgomery form
+
+    explicit montgomery(uint64_t modulus)
+        : n(modulus), ni(inverse(modulus)), one(-modulus % modulus) {}
+
+    static constexpr uint64_t inverse(uint64_t n) {
+        uint64_t inv = n; // n * n = 1 mod 8 for odd n, each step doubles the bits
+        for(int i = 0; i != 5; ++i) inv *= 2 - n * inv;
+        return inv;
+    }
+
+    uint64_t add(uint64_t a, uint64_t b) const {
+        const uint64_t s = a + b;
+        return (s < a || s >= n) ? s - n : s;
+    }
+
+    uint64_t mul(uint64_t a, uint64_t b) const {
+        const __uint128_t ab = static_cast<__uint128_t>(a) * b;
+        const uint64_t q = static_cast<uint64_t>(ab) * ni;
+        const uint64_t t = (static_cast<__uint128_t>(q) * n) >> 64;
+        const uint64_t h = ab >> 64;
+        return h < t ? h - t + n : h - t;
+    }
+
+    uint64_t to(uint64_t x) const {
+        return mul(x % n, static_cast<uint64_t>((static_cast<__uint128_t>(one) << 64) % n));
+    }
+
+    uint64_t from(uint64_t x) const {
+        const uint64_t q = x * ni;
+        const uint64_t t = (static_cast<__uint128_t>(q) * n) >> 64;
+        return t ? n - t : 0;
+    }
+};
+
+static_assert(modular_arithmetic<montgomery>);
@@ -0,0 +1,107 @@
+#include "options.h"
+
+#include <algorithm>
+#include <getopt.h>
+#include <stdexcept>
+
+const char usage[] =
+    "usage: ord23 [options]\n"
+    "  -s, --start N     first number to search (default 0)\n"
+    "  -e, --end N       search below N (default 10^13)\n"
+    "  -t, --threads N   worker threads (default: hardware threads)\n"
+    "  -b, --block N     numbers per scheduled block (default: from the range)\n"
+    "  -o, --output F    also append hits to F, one per line\n"
+    "      --json        write hits as JSON lines with their orders and p - 1\n"
+    "      --no-color    never colour hits on the terminal\n"
+    "      --status N    print rates and an ETA to stderr every N seconds (default 10, 0: never)\n"
+    "      --metrics F   keep Prometheus metrics in F, rewritten every 10 seconds\n"
+    "      --metrics-port N  serve the same metrics over HTTP on 127.0.0.1:N\n"
+    "  -j, --journal F   progress journal (default ord23.journal)\n"
+    "  -r, --resume      continue the search recorded in the journal\n"
+    "  -h, --help        print this help\n"
+    "Numbers may be written as 12345, 10^13, 2^63 or 1e13.\n";
+
+namespace {
+
+uint64_t parse_digits(const std::string &text, const std::string &whole) {
+    if(text.empty() || !std::all_of(text.begin(), text.end(), [](char c) {return c >= '0' && c <= '9';}))
+        throw std::invalid_argument("not a number: " + whole);
+    uint64_t value {0};
+    for(char c : text) {
+        if(value > (UINT64_MAX - (c - '0')) / 10) throw std::invalid_argument("number too large: " + whole);
+        value = 10 * value + (c - '0');
+    }
+    return value;
+}
+
+uint64_t checked_power(uint64_t factor, uint64_t base, uint64_t exponent, const std::string &whole) {
+    for(; exponent; --exponent) {
+        if(base != 0 && factor > UINT64_MAX / base) throw std::invalid_argument("number too large: " + whole);
+        factor *= base;
+    }
+    return factor;
+}
+
+}
+
+uint64_t parse_number(const std::string &text) {
+    if(const auto caret = text.find('^'); caret != std::string::npos) {
+        return checked_power(1, parse_digits(text.substr(0, caret), text),
+                             parse_digits(text.substr(caret + 1), text), text);
+    }
+    if(const auto e = text.find_first_of("eE"); e != std::string::npos) {
+        return checked_power(parse_digits(text.substr(0, e), text), 10,
+                             parse_digits(text.substr(e + 1), text), text);
+    }
+    return parse_digits(text, text);
+}
+
+options parse_options(int argc, char *argv[]) {
+    const option long_options[] {
+        {"start", required_argument, nullptr, 's'},
+        {"end", required_argument, nullptr, 'e'},
+        {"threads", required_argument, nullptr, 't'},
+        {"block", required_argument, nullptr, 'b'},
+        {"output", required_argument, nullptr, 'o'},
+        {"journal", required_argument, nullptr, 'j'},
+        {"resume", no_argument, nullptr, 'r'},
+        {"json", no_argument, nullptr, 'J'},
+        {"no-color", no_argument, nullptr, 'C'},
+        {"status", required_argument, nullptr, 'S'},
+        {"metrics", required_argument, nullptr, 'M'},
+        {"metrics-port", required_argument, nullptr, 'P'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    options opts;
+    optind = 0;
+    opterr = 0;
+    for(int c; (c = getopt_long(argc, argv, "s:e:t:b:o:j:rh", long_options, nullptr)) != -1;) {
+        switch(c) {
+            case 's': opts.start = parse_number(optarg); break;
+            case 'e': opts.end = parse_number(optarg); break;
+            case 't': opts.threads = std::min<uint64_t>(parse_number(optarg), 1 << 16); break;
+            case 'b': opts.block = parse_number(optarg); break;
+            case 'o': opts.output = optarg; break;
+            case 'j': opts.journal = optarg; break;
+            case 'r': opts.resume = true; break;
+            case 'J': opts.json = true; break;
+            case 'C': opts.color = false; break;
+            case 'S': opts.status = std::min<uint64_t>(parse_number(optarg), 86'400); break;
+            case 'M': opts.metrics = optarg; break;
+            case 'P': opts.metrics_port = std::min<uint64_t>(parse_number(optarg), 65'536); break;
+            case 'h': opts.help = true; break;
+            default: throw std::invalid_argument(std::string("unknown or incomplete option: ") + argv[optind - 1]);
+        }
+    }
+    if(optind != argc) throw std::invalid_argument(std::string("unexpected argument: ") + argv[optind]);
+    if(opts.start >= opts.end) throw std::invalid_argument("--start must be below --end");
+    if(opts.metrics_port > 65'535) throw std::invalid_argument("--metrics-port must be below 65536");
+    if(opts.block == 0) opts.block = default_block(opts.start, opts.end);
+    return opts;
+}
+
+uint64_t default_block(uint64_t start, uint64_t end) {
+    return std::clamp<uint64_t>((end - start) / 1'000, 1'000'000, 100'000'000);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct options {
+    uint64_t start {0};
+    uint64_t end {10'000'000'000'000};
+    uint64_t block {0};   // 0 picks a block size from the range
+    unsigned threads {0}; // 0 runs one thread per hardware thread
+    std::string output;   // empty writes hits to stdout only
+    std::string journal {"ord23.journal"};
+    bool resume {false};
+    bool json {false};    // hits as JSON lines instead of bare numbers
+    bool color {true};    // colour hits when stdout is a terminal
+    unsigned status {10}; // seconds between status lines on stderr, 0 for none
+    std::string metrics;  // Prometheus textfile to keep up to date, empty for none
+    unsigned metrics_port {0}; // serve the metrics on 127.0.0.1, 0 for not at all
+    bool help {false};
+};
+
+extern const char usage[];
+
+// Parses 12345, 10^13, 2^63 or 1e13. Throws std::invalid_argument.
+uint64_t parse_number(const std::string &text);
+
+// Throws std::invalid_argument on unknown options or inconsistent values.
+options parse_options(int argc, char *argv[]);
+
+// Block size used when --block is not given: about a thousand blocks per
+// range, and never more than 10^8 numbers so a block finishes in seconds.
+uint64_t default_block(uint64_t start, uint64_t end);
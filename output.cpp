@@ -0,0 +1,117 @@
+#include "output.h"
+#include "utils.h"
+#include "rang.hpp"
+
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+hit_record make_record(uint64_t p, uint64_t block, std::optional<std::chrono::system_clock::time_point> time) {
+    hit_record hit {p, 0, 0, {}, block, time};
+    if(p > 2) {
+        hit.factors = factorize(p - 1);
+        hit.order_two = multiplicative_order(2, p, hit.factors);
+        hit.order_three = p > 3 ? multiplicative_order(3, p, hit.factors) : 0;
+    }
+    return hit;
+}
+
+std::string to_json(const hit_record &hit) {
+    std::ostringstream out;
+    out << "{\"p\":" << hit.prime << ",\"ord2\":" << hit.order_two << ",\"ord3\":" << hit.order_three
+        << ",\"factors\":[";
+    for(std::size_t i = 0; i != hit.factors.count; ++i) {
+        out << (i ? ",[" : "[") << hit.factors.f[i].p << ',' << hit.factors.f[i].e << ']';
+    }
+    out << "],\"block\":" << hit.block << ",\"time\":";
+    if(!hit.time) {
+        out << "null}";
+        return out.str();
+    }
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(hit.time->time_since_epoch()).count();
+    const std::time_t seconds = ms / 1000;
+    std::tm utc;
+    gmtime_r(&seconds, &utc);
+    out << '"' << std::put_time(&utc, "%FT%T") << '.' << std::setfill('0') << std::setw(3) << ms % 1000 << "Z\"}";
+    return out.str();
+}
+
+output_channel::output_channel(std::ostream &terminal, std::ostream *hits_file, bool json_lines)
+    : console(terminal), file(hits_file), json(json_lines), head(&stub), tail(&stub), writer([this] {run();}) {}
+
+output_channel::~output_channel() {
+    closing = true;
+    writer.join();
+}
+
+void output_channel::hit(uint64_t p, uint64_t block) {
+    push(new event {{nullptr}, p, block, std::chrono::system_clock::now(), false});
+}
+
+void output_channel::block_done(uint64_t block) {
+    push(new event {{nullptr}, 0, block, {}, false});
+}
+
+void output_channel::replay(uint64_t p, uint64_t block) {
+    push(new event {{nullptr}, p, block, {}, true});
+}
+
+void output_channel::push(event *e) {
+    e->next.store(nullptr, std::memory_order_relaxed);
+    event *previous = head.exchange(e, std::memory_order_acq_rel);
+    previous->next.store(e, std::memory_order_release);
+}
+
+// nullptr when the queue is empty, or when a push is half done: its
+// exchange happened but not yet the link, so the writer comes back later.
+output_channel::event *output_channel::pop() {
+    event *t = tail;
+    event *next = t->next.load(std::memory_order_acquire);
+    if(t == &stub) {
+        if(!next) return nullptr;
+        tail = t = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if(next) {
+        tail = next;
+        return t;
+    }
+    if(t != head.load(std::memory_order_acquire)) return nullptr;
+    push(&stub);
+    next = t->next.load(std::memory_order_acquire);
+    if(!next) return nullptr;
+    tail = next;
+    return t;
+}
+
+void output_channel::write(const event &e) {
+    if(e.prime == 0) {
+        if(!json) console << '.' << std::flush;
+        return;
+    }
+    const auto hit = make_record(e.prime, e.block, e.replayed ? std::nullopt : std::optional(e.time));
+    if(json) {
+        const auto line = to_json(hit);
+        console << line << '\n' << std::flush;
+        if(file && !e.replayed) *file << line << '\n' << std::flush;
+    }
+    else {
+        console << '\n' << rang::fgB::red << e.prime << rang::fg::reset << std::flush;
+        if(file && !e.replayed) *file << e.prime << '\n' << std::flush;
+    }
+}
+
+void output_channel::run() {
+    for(;;) {
+        // read closing first, so nothing pushed before it was set is missed
+        const bool last = closing;
+        bool any {false};
+        while(event *e = pop()) {
+            write(*e);
+            delete e;
+            any = true;
+        }
+        if(last && !any && head.load(std::memory_order_acquire) == tail) return;
+        if(!any) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "factor.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// A hit as written out: p with the orders of 2 and 3 modulo p, the
+// factorisation of p - 1, the block it was found in and when, unless it was
+// found by an earlier run and only replayed from the journal.
+struct hit_record {
+    uint64_t prime;
+    uint64_t order_two;
+    uint64_t order_three;
+    factorization factors;
+    uint64_t block;
+    std::optional<std::chrono::system_clock::time_point> time;
+};
+
+hit_record make_record(uint64_t p, uint64_t block, std::optional<std::chrono::system_clock::time_point> time);
+
+// One line, with no newline, and "time":null for a replayed hit:
+// {"p":683,"ord2":22,"ord3":31,"factors":[[2,1],[11,1],[31,1]],"block":0,"time":"2026-01-01T00:00:00.000Z"}
+std::string to_json(const hit_record &hit);
+
+// Carries hits and finished blocks from the workers to one writer thread,
+// which does all the formatting and I/O, so a worker never waits on the
+// console or a file. The workers push onto a lock-free intrusive queue
+// (Vyukov's multi-producer single-consumer list): one atomic exchange per
+// event, and no lock anywhere.
+//
+// The console gets each hit on its own line, coloured through rang when it
+// allows, and a dot per block; with json, one JSON line per hit and nothing
+// else. A file, when given, gets every hit as well, as a bare number or a
+// JSON line.
+class output_channel {
+public:
+    output_channel(std::ostream &terminal, std::ostream *hits_file, bool json_lines);
+
+    // Writes out everything pushed so far.
+    ~output_channel();
+
+    output_channel(const output_channel &) = delete;
+    output_channel &operator=(const output_channel &) = delete;
+
+    // All safe to call from any number of threads.
+    void hit(uint64_t p, uint64_t block);
+    void block_done(uint64_t block);
+
+    // A hit an earlier run of the search found and recorded, shown on the
+    // console only, since the file has it already, and with no time.
+    void replay(uint64_t p, uint64_t block);
+
+private:
+    struct event {
+        std::atomic<event *> next {nullptr};
+        uint64_t prime; // 0 for a finished block
+        uint64_t block;
+        std::chrono::system_clock::time_point time;
+        bool replayed {false};
+    };
+
+    void push(event *e);
+    event *pop();
+    void write(const event &e);
+    void run();
+
+    std::ostream &console;
+    std::ostream *file;
+    bool json;
+
+    alignas(64) std::atomic<event *> head; // the last event pushed
+    alignas(64) event *tail;               // the writer's end
+    event stub;
+    std::atomic<bool> closing {false};
+    std::thread writer;
+};
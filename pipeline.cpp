@@ -0,0 +1,102 @@
+#include "pipeline.h"
+#include "utils.h"
+
+#include <chrono>
+
+namespace {
+
+using stage_clock = std::chrono::steady_clock;
+
+std::size_t count(stage_counts &counts, std::size_t in, std::size_t kept, stage_clock::time_point start) {
+    counts.in += in;
+    counts.kept += kept;
+    counts.ns += std::chrono::duration_cast<std::chrono::nanoseconds>(stage_clock::now() - start).count();
+    return kept;
+}
+
+}
+
+pipeline_counts &pipeline_counts::operator+=(const pipeline_counts &other) {
+    for(auto [mine, theirs] : {std::pair{&residues, &other.residues}, {&small_orders, &other.small_orders},
+                               {&factorize, &other.factorize}, {&large_orders, &other.large_orders}}) {
+        mine->in += theirs->in;
+        mine->kept += theirs->kept;
+        mine->ns += theirs->ns;
+    }
+    return *this;
+}
+
+coprime_pipeline::coprime_pipeline(factor_sieve *factors, two_part_kernel ladder, modular_engine arithmetic)
+    : sieve(factors), kernel(ladder), engine(arithmetic) {}
+
+std::size_t coprime_pipeline::residues(std::span<uint64_t> primes) {
+    const auto start = stage_clock::now();
+    return count(totals.residues, primes.size(), filter_residues(primes), start);
+}
+
+// 3 divides ord(a) exactly when a^m != 1, for p - 1 = 3^t * m and 3 not
+// dividing m, the same test as q = 2.
+std::size_t coprime_pipeline::small_orders(std::span<uint64_t> primes) {
+    const auto start = stage_clock::now();
+    two_part_counts ladder;
+    const auto survivors = filter_two_part(primes, kernel, ladder);
+    exponentiations += 2 * (ladder.primes - ladder.residues - ladder.decided);
+    std::size_t out {0};
+    for(std::size_t i = 0; i != survivors; ++i) {
+        const auto p = primes[i];
+        if(p % 3 == 1) {
+            uint64_t m = (p - 1) / 3;
+            while(m % 3 == 0) m /= 3;
+            const bool divides = with_engine(engine, p, [&](const auto &mod) {
+                const auto two = mod.add(mod.one, mod.one);
+                uint64_t r2, r3;
+                mod.pow(two, mod.add(two, mod.one), m, r2, r3);
+                return r2 != mod.one && r3 != mod.one;
+            });
+            if(divides) continue;
+        }
+        primes[out++] = p;
+    }
+    return count(totals.small_orders, primes.size(), out, start);
+}
+
+std::size_t coprime_pipeline::factorize(std::span<uint64_t> primes) {
+    const auto start = stage_clock::now();
+    factorizations.resize(primes.size());
+    rests.resize(primes.size());
+    if(sieve) {
+        for(std::size_t i = 0; i != primes.size(); ++i) factorizations[i] = sieve->factorize(primes[i] - 1);
+        std::fill(rests.begin(), rests.end(), 1);
+    }
+    else {
+        constexpr std::size_t chunk {64};
+        for(std::size_t i = 0; i < primes.size(); i += chunk) {
+            const auto n = std::min(chunk, primes.size() - i);
+            uint64_t minus_one[chunk];
+            factors f[chunk];
+            for(std::size_t j = 0; j != n; ++j) minus_one[j] = primes[i + j] - 1;
+            factor_block_small(minus_one, n, f, &rests[i]);
+            for(std::size_t j = 0; j != n; ++j) factorizations[i + j] = ::factorize(f[j]);
+        }
+    }
+    return count(totals.factorize, primes.size(), primes.size(), start);
+}
+
+std::size_t coprime_pipeline::large_orders(std::span<uint64_t> primes) {
+    const auto start = stage_clock::now();
+    std::size_t out {0};
+    for(std::size_t i = 0; i != primes.size(); ++i) {
+        const bool coprime = with_engine(engine, primes[i], [&](const auto &m) {
+            return coprime_large_orders(factorizations[i], m, rests[i]);
+        });
+        if(coprime) primes[out++] = primes[i];
+    }
+    return count(totals.large_orders, primes.size(), out, start);
+}
+
+std::size_t coprime_pipeline::run(std::span<uint64_t> primes) {
+    auto n = residues(primes);
+    n = small_orders(primes.first(n));
+    n = factorize(primes.first(n));
+    return large_orders(primes.first(n));
+}
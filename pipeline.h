@@ -0,0 +1,64 @@
+#pragma once
+
+#include "utils.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// coprime_orders for a block of primes as a chain of stages, cheapest first:
+//   residues      q = 2 from p mod 24, the Legendre symbols of 2 and 3
+//   small_orders  q = 2 on the vector ladder, then q = 3
+//   factorize     p - 1, from the factor sieve when there is one, else
+//                 only its primes below 5003, by batched trial division
+//   large_orders  the primes above 3 of p - 1, those of the part left by
+//                 trial division last, factoring it only if they pass
+// Each stage takes the survivors of the one before in bulk, moves the primes
+// it keeps to the front of its span, keeping their order, and returns how
+// many there are, and adds to its counters. The vector ladder of
+// small_orders counts towards exponentiations like the scalar ones.
+// The stages can be run separately and in another order,
+// except that large_orders reads the factorisations left by factorize and
+// must come right after it, on the same primes.
+
+struct stage_counts {
+    uint64_t in {0};
+    uint64_t kept {0};
+    uint64_t ns {0}; // time spent in the stage
+};
+
+struct pipeline_counts {
+    stage_counts residues;
+    stage_counts small_orders;
+    stage_counts factorize;
+    stage_counts large_orders;
+
+    pipeline_counts &operator+=(const pipeline_counts &other);
+};
+
+class coprime_pipeline {
+public:
+    // Without a sieve, p - 1 is factored with factor_block. A sieve must
+    // cover the p - 1 of every prime, given in increasing order. The scalar
+    // stages run on the given modular engine.
+    explicit coprime_pipeline(factor_sieve *factors = nullptr, two_part_kernel ladder = best_two_part_kernel(),
+                              modular_engine arithmetic = modular_engine::montgomery);
+
+    std::size_t residues(std::span<uint64_t> primes);
+    std::size_t small_orders(std::span<uint64_t> primes);
+    std::size_t factorize(std::span<uint64_t> primes);
+    std::size_t large_orders(std::span<uint64_t> primes);
+
+    // The four stages in turn.
+    std::size_t run(std::span<uint64_t> primes);
+
+    const pipeline_counts &counts() const { return totals; }
+
+private:
+    factor_sieve *sieve;
+    two_part_kernel kernel;
+    modular_engine engine;
+    std::vector<factorization> factorizations; // of p - 1, for primes[i] after factorize
+    std::vector<uint64_t> rests;               // the part of p - 1 not in factorizations[i]
+    pipeline_counts totals;
+};
@@ -1,472 +1,324 @@
 #include <nanobench.h>
 #include <atomic>
+#include <random>
 #include "utils.h"
+#include "factor_cache.h"
+#include "pipeline.h"
+#include "metrics.h"
+#include <filesystem>
+
+// Counts every heap allocation, to check the hot path makes none.
+std::atomic<std::size_t> allocations {0};
+
+void *operator new(std::size_t size) {
+    ++allocations;
+    if(void *p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
 
-uint64_t modpow0(uint64_t base, uint64_t exponent, uint64_t modulus) {
-    base %= modulus;
-    uint64_t result {1};
-    while (exponent > 0)
-    {
-       //if (exponent & 1) result = (result * base) % modulus;
-        //base = (base * base) % modulus;
-        if (exponent & 1) result = result * base % modulus;
-        base = base * base % modulus;
-        exponent >>= 1;
-    }
-    return result;
+void operator delete(void *p) noexcept {
+    std::free(p);
 }
 
-std::vector<uint64_t> order0(std::map<uint64_t, uint64_t> factors, const uint64_t n, uint64_t p) {
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+std::vector<uint64_t> order_ladders(factor_span factors, const montgomery &m, uint64_t base) {
     namespace view = std::ranges::views;
-    uint64_t group_order = p - 1;
+    uint64_t group_order = m.n - 1;
     std::vector<uint64_t> order;
     for (const auto& [P, e] : factors)
     {
         uint64_t exponent = group_order;
         for (const auto f: view::iota(0ull, e + 1))
         {
-            if (modpow0(n, exponent, p) != 1)
+            if (m.pow(base, exponent) != m.one)
             {
-                uint64_t alpha = P;
-                uint64_t beta =  e - f + 1;
-                //std::cout << pow(alpha, beta) << " ";
-                //order *= pow(alpha, beta);
-                order.push_back(alpha);
-                
+                order.push_back(P);
                 break;
             }
             exponent /= P;
         }
-
     }
     return order;
 }
 
-bool coprime_orders0(uint64_t p)
-{
-    if(p == 2 || p == 3) return false;
-    const auto factors = factorint(p - 1);
-    const constexpr uint64_t two = 2;
-    const auto mo2 = order0(factors, two, p);
-    const constexpr uint64_t three = 3;
-    const auto mo3 = order0(factors, three, p);
-    for(auto n1 : mo2) {
-        if(std::binary_search(mo3.begin(), mo3.end(), n1)) {
-            return false;
-        }
-    } 
-    return true;
+std::vector<uint64_t> order_two_ladders(factor_span factors, const montgomery &m) {
+    return order_ladders(factors, m, m.add(m.one, m.one));
 }
 
-std::map<__uint128_t, __uint128_t> factorint1(const __uint128_t num)
-{
-    __uint128_t p1 {num};
-    auto a = factors{};
-    auto result = std::map<__uint128_t, __uint128_t>{};
-    factor(p1, &a);
+std::vector<uint64_t> order_three_ladders(factor_span factors, const montgomery &m) {
+    return order_ladders(factors, m, m.add(m.add(m.one, m.one), m.one));
+}
 
-    for (unsigned int j = 0; j < a.nfactors; j++)
-        result[a.p[j]] = a.e[j];
+int main() {
 
-    return result;
-}
+    const auto primes = base_primes(10'000'000'000'000ull); // all the primes less than 10^6.5
 
-__uint128_t modpow1(__uint128_t base, __uint128_t exponent, __uint128_t modulus) {
-    base %= modulus;
-    __uint128_t result {1};
-    while (exponent > 0)
-    {
-       //if (exponent & 1) result = (result * base) % modulus;
-        //base = (base * base) % modulus;
-        if (exponent & 1) result = result * base % modulus;
-        base = base * base % modulus;
-        exponent >>= 1;
-    }
-    return result;
-}
+    ankerl::nanobench::Bench().run("base primes below sqrt(10^13)", [&] {
+        ankerl::nanobench::doNotOptimizeAway(base_primes(10'000'000'000'000ull));
+    });
 
-std::vector<__uint128_t> order1(std::map<__uint128_t, __uint128_t> factors, const __uint128_t n, __uint128_t p) {
-    namespace view = std::ranges::views;
-    __uint128_t group_order = p - 1;
-    std::vector<__uint128_t> order;
-    for (const auto& [P, e] : factors)
-    {
-        __uint128_t exponent = group_order;
-        for (const auto f: view::iota(0ull, e + 1))
-        {
-            if (modpow1(n, exponent, p) != 1)
-            {
-                __uint128_t alpha = P;
-                __uint128_t beta =  e - f + 1;
-                //std::cout << pow(alpha, beta) << " ";
-                //order *= pow(alpha, beta);
-                order.push_back(alpha);
-                
-                break;
-            }
-            exponent /= P;
+    const auto sample = batch(primes, 1'000'000'000'000ull, 1'000'000'100'000ull);
+
+    ankerl::nanobench::Bench().run("2^(p-1) and 3^(p-1) for primes after 10^12 (mulmod, shifted powers of two)", [&] {
+        for(auto p : sample) {
+            ankerl::nanobench::doNotOptimizeAway(modpow_two(p - 1, p) + modpow_three(p - 1, p));
         }
+    });
 
+    for(const auto engine : modular_engines) {
+        ankerl::nanobench::Bench().run(std::string("2^(p-1) and 3^(p-1) for primes after 10^12 (") + engine_name(engine) + ")", [&] {
+            for(auto p : sample) {
+                with_engine(engine, p, [&](const auto &m) {
+                    ankerl::nanobench::doNotOptimizeAway(modpow_two(p - 1, m) + modpow_three(p - 1, m));
+                });
+            }
+        });
     }
-    return order;
-}
 
-bool coprime_orders1(__uint128_t p)
-{
-    if(p == 2 || p == 3) return false;
-    const auto factors = factorint1(p - 1);
-    const constexpr __uint128_t two = 2;
-    const auto mo2 = order1(factors, two, p);
-    const constexpr __uint128_t three = 3;
-    const auto mo3 = order1(factors, three, p);
-    for(auto n1 : mo2) {
-        if(std::binary_search(mo3.begin(), mo3.end(), n1)) {
-            return false;
-        }
-    } 
-    return true;
-}
+    std::vector<factorization> sample_factors;
+    for(auto p : sample) sample_factors.push_back(factorize(p - 1));
 
-uint64_t mulmod2(uint64_t a, uint64_t b, uint64_t m) {
-  uint64_t r;
-  __asm__
-  ( "mulq %2\n\t"
-      "divq %3"
-      : "=&d" (r), "+%a" (a)
-      : "rm" (b), "rm" (m)
-      : "cc"
-  );
-  return r;
-}
+    ankerl::nanobench::Bench().run("factor p - 1 for primes after 10^12 (std::map)", [&] {
+        for(auto p : sample) ankerl::nanobench::doNotOptimizeAway(factorint(p - 1));
+    });
 
-uint64_t modpow2(uint64_t base, uint64_t exponent, uint64_t modulus) {
-    base %= modulus;
-    uint64_t result {1};
-    while (exponent > 0)
-    {
-       //if (exponent & 1) result = (result * base) % modulus;
-        //base = (base * base) % modulus;
-        if (exponent & 1) result = mulmod2(result, base, modulus);
-        base = mulmod2(base, base, modulus);
-        exponent >>= 1;
-    }
-    return result;
-}
+    ankerl::nanobench::Bench().run("factor p - 1 for primes after 10^12 (on the stack)", [&] {
+        for(auto p : sample) ankerl::nanobench::doNotOptimizeAway(factorize(p - 1));
+    });
 
-std::vector<uint64_t> order2(std::map<uint64_t, uint64_t> factors, const uint64_t n, uint64_t p) {
-    namespace view = std::ranges::views;
-    uint64_t group_order = p - 1;
-    std::vector<uint64_t> order;
-    for (const auto& [P, e] : factors)
-    {
-        uint64_t exponent = group_order;
-        for (const auto f: view::iota(0ull, e + 1))
-        {
-            if (modpow2(n, exponent, p) != 1)
-            {
-                uint64_t alpha = P;
-                uint64_t beta =  e - f + 1;
-                //std::cout << pow(alpha, beta) << " ";
-                //order *= pow(alpha, beta);
-                order.push_back(alpha);
-                
-                break;
-            }
-            exponent /= P;
+    const auto allocations_per_prime = [&](auto &&f) {
+        const std::size_t before = allocations;
+        for(auto p : sample) ankerl::nanobench::doNotOptimizeAway(f(p));
+        return double(allocations - before) / sample.size();
+    };
+    std::cout << "allocations per prime: factorint " << allocations_per_prime([](uint64_t p) {return factorint(p - 1);})
+              << ", factorize " << allocations_per_prime([](uint64_t p) {return factorize(p - 1);})
+              << ", coprime_orders " << allocations_per_prime([](uint64_t p) {return coprime_orders(p);}) << "\n";
+
+    ankerl::nanobench::Bench().run("order_two and order_three for primes after 10^12 (ladder per prime power)", [&] {
+        for(std::size_t i = 0; i != sample.size(); ++i) {
+            const auto &factors = sample_factors[i];
+            const montgomery m(sample[i]);
+            ankerl::nanobench::doNotOptimizeAway(order_two_ladders(factors, m));
+            ankerl::nanobench::doNotOptimizeAway(order_three_ladders(factors, m));
         }
+    });
 
-    }
-    return order;
-}
+    ankerl::nanobench::Bench().run("order_two and order_three for primes after 10^12 (shared tree)", [&] {
+        for(std::size_t i = 0; i != sample.size(); ++i) {
+            const auto &factors = sample_factors[i];
+            const montgomery m(sample[i]);
+            bool divides[MAX_NFACTS];
+            order_divisors(factors, m, m.add(m.one, m.one), divides);
+            order_divisors(factors, m, m.add(m.add(m.one, m.one), m.one), divides);
+            ankerl::nanobench::doNotOptimizeAway(divides);
+        }
+    });
 
-bool coprime_orders2(uint64_t p)
-{
-    if(p == 2 || p == 3) return false;
-    const auto factors = factorint(p - 1);
-    const constexpr uint64_t two = 2;
-    const auto mo2 = order2(factors, two, p);
-    const constexpr uint64_t three = 3;
-    const auto mo3 = order2(factors, three, p);
-    for(auto n1 : mo2) {
-        if(std::binary_search(mo3.begin(), mo3.end(), n1)) {
-            return false;
+    ankerl::nanobench::Bench().run("coprime orders for primes after 10^12 (fused, early exit)", [&] {
+        for(std::size_t i = 0; i != sample.size(); ++i) {
+            ankerl::nanobench::doNotOptimizeAway(coprime_orders(sample_factors[i], montgomery(sample[i])));
         }
-    } 
-    return true;
-}
+    });
 
-uint64_t mulmod3(uint64_t a, uint64_t b, uint64_t m) {
-    int64_t res = 0;
-    while (a != 0) {
-        if (a & 1) res = (res + b) % m;
-        a >>= 1;
-        b = (b << 1) % m;
+    for(const auto kernel : {two_part_kernel::scalar, two_part_kernel::avx2, two_part_kernel::ifma}) {
+        if(!supported(kernel)) continue;
+        const std::string name = std::string("two-part filter for primes after 10^12 (") + kernel_name(kernel) + ")";
+        std::vector<uint64_t> block;
+        ankerl::nanobench::Bench().run(name, [&] {
+            block = sample;
+            ankerl::nanobench::doNotOptimizeAway(filter_two_part(block, kernel));
+        });
     }
-    return res;
-}
-
-uint64_t modpow3(uint64_t base, uint64_t exponent, uint64_t modulus) {
-    base %= modulus;
-    uint64_t result {1};
-    while (exponent > 0)
     {
-       //if (exponent & 1) result = (result * base) % modulus;
-        //base = (base * base) % modulus;
-        if (exponent & 1) result = mulmod3(result, base, modulus);
-        base = mulmod3(base, base, modulus);
-        exponent >>= 1;
+        two_part_counts counts;
+        auto block = sample;
+        const auto left = filter_two_part(block, best_two_part_kernel(), counts);
+        std::cout << "two-part filter: " << counts.primes << " primes, "
+                  << 100.0 * counts.residues / counts.primes << "% rejected from p mod 24, "
+                  << 100.0 * counts.decided / counts.primes << "% passed from p mod 24, "
+                  << 100.0 * counts.ladder / counts.primes << "% rejected by the ladder, "
+                  << 100.0 * left / counts.primes << "% left to factor\n";
     }
-    return result;
-}
-
-std::vector<uint64_t> order3(std::map<uint64_t, uint64_t> factors, const uint64_t n, uint64_t p) {
-    namespace view = std::ranges::views;
-    uint64_t group_order = p - 1;
-    std::vector<uint64_t> order;
-    for (const auto& [P, e] : factors)
     {
-        uint64_t exponent = group_order;
-        for (const auto f: view::iota(0ull, e + 1))
-        {
-            if (modpow3(n, exponent, p) != 1)
-            {
-                uint64_t alpha = P;
-                uint64_t beta =  e - f + 1;
-                //std::cout << pow(alpha, beta) << " ";
-                //order *= pow(alpha, beta);
-                order.push_back(alpha);
-                
-                break;
-            }
-            exponent /= P;
+        // every stage on the survivors of the ones before it
+        coprime_pipeline pipeline;
+        auto input = sample;
+        const auto stage = [&](const char *name, auto run) {
+            std::vector<uint64_t> block;
+            ankerl::nanobench::Bench().run(std::string("pipeline stage for primes after 10^12 (") + name + ")", [&] {
+                block = input;
+                ankerl::nanobench::doNotOptimizeAway(run(std::span(block)));
+            });
+            input.resize(run(std::span(input)));
+        };
+        stage("residues", [&](std::span<uint64_t> b) {return pipeline.residues(b);});
+        stage("small_orders", [&](std::span<uint64_t> b) {return pipeline.small_orders(b);});
+        stage("factorize", [&](std::span<uint64_t> b) {return pipeline.factorize(b);});
+        stage("large_orders", [&](std::span<uint64_t> b) {return pipeline.large_orders(b);});
+
+        coprime_pipeline once;
+        auto block = sample;
+        once.run(block);
+        const auto &c = once.counts();
+        for(const auto &[name, s] : {std::pair{"residues", c.residues}, {"small_orders", c.small_orders},
+                                     {"factorize", c.factorize}, {"large_orders", c.large_orders}}) {
+            std::cout << "pipeline " << name << ": " << s.in << " in, "
+                      << 100.0 * (s.in - s.kept) / s.in << "% rejected\n";
         }
-
     }
-    return order;
-}
 
-bool coprime_orders3(uint64_t p)
-{
-    if(p == 2 || p == 3) return false;
-    const auto factors = factorint(p - 1);
-    const constexpr uint64_t two = 2;
-    const auto mo2 = order3(factors, two, p);
-    const constexpr uint64_t three = 3;
-    const auto mo3 = order3(factors, three, p);
-    for(auto n1 : mo2) {
-        if(std::binary_search(mo3.begin(), mo3.end(), n1)) {
-            return false;
-        }
-    } 
-    return true;
-}
-
-#include <cmath>
+    ankerl::nanobench::Bench().run("batch of 10^6 numbers after 10^12 (vector pipeline)", [&] {
+        auto v = batch(primes, 1'000'000'000'000ull, 1'000'001'000'000ull);
+        ankerl::nanobench::doNotOptimizeAway(coprime_orders(std::span<uint64_t>(v)));
+    });
 
-uint64_t mulmod4(uint64_t a, uint64_t b, uint64_t p) {
-	uint64_t k = static_cast<uint64_t>(std::pow(2.0, std::log2(a) + std::log2(b) - 64.0));
-	return (a * b) % p  + (k * ((1 + ~p) % p)) % p;
-}
+    ankerl::nanobench::Bench().run("factor p - 1 for primes after 10^12 (factor_block)", [&] {
+        std::vector<uint64_t> minus_one;
+        for(auto p : sample) minus_one.push_back(p - 1);
+        std::vector<factors> f(minus_one.size());
+        factor_block(minus_one.data(), minus_one.size(), f.data());
+        ankerl::nanobench::doNotOptimizeAway(f);
+    });
 
-uint64_t modpow4(uint64_t base, uint64_t exponent, uint64_t modulus) {
-    base %= modulus;
-    uint64_t result {1};
-    while (exponent > 0)
     {
-       //if (exponent & 1) result = (result * base) % modulus;
-        //base = (base * base) % modulus;
-        if (exponent & 1) result = mulmod4(result, base, modulus);
-        base = mulmod4(base, base, modulus);
-        exponent >>= 1;
+        std::vector<uint64_t> block(100'000);
+        std::iota(block.begin(), block.end(), 10'000'000'000'000ull);
+        std::vector<factors> f(block.size());
+        ankerl::nanobench::Bench().run("factor a block of 10^5 numbers after 10^13 (factor)", [&] {
+            for(std::size_t i = 0; i != block.size(); ++i) factor(block[i], &f[i]);
+            ankerl::nanobench::doNotOptimizeAway(f);
+        });
+        ankerl::nanobench::Bench().run("factor a block of 10^5 numbers after 10^13 (factor_block)", [&] {
+            factor_block(block.data(), block.size(), f.data());
+            ankerl::nanobench::doNotOptimizeAway(f);
+        });
     }
-    return result;
-}
 
-std::vector<uint64_t> order4(std::map<uint64_t, uint64_t> factors, const uint64_t n, uint64_t p) {
-    namespace view = std::ranges::views;
-    uint64_t group_order = p - 1;
-    std::vector<uint64_t> order;
-    for (const auto& [P, e] : factors)
     {
-        uint64_t exponent = group_order;
-        for (const auto f: view::iota(0ull, e + 1))
-        {
-            if (modpow4(n, exponent, p) != 1)
-            {
-                uint64_t alpha = P;
-                uint64_t beta =  e - f + 1;
-                //std::cout << pow(alpha, beta) << " ";
-                //order *= pow(alpha, beta);
-                order.push_back(alpha);
-                
-                break;
-            }
-            exponent /= P;
-        }
-
+        // a fresh memo every pass, as a worker would see the window once
+        const auto window = batch(primes, 1'000'000'000'000ull, 1'000'001'000'000ull);
+        ankerl::nanobench::Bench().run("factor p - 1 for a 10^6 window after 10^12 (no memo)", [&] {
+            for(auto p : window) ankerl::nanobench::doNotOptimizeAway(factorize(p - 1));
+        });
+        uint64_t hits {0}, misses {0};
+        ankerl::nanobench::Bench().run("factor p - 1 for a 10^6 window after 10^12 (LRU memo of 2^16 cofactors)", [&] {
+            factor_cache cache(1 << 16);
+            factor_cache::scope scope(cache);
+            for(auto p : window) ankerl::nanobench::doNotOptimizeAway(factorize(p - 1));
+            hits = cache.hits();
+            misses = cache.misses();
+        });
+        std::cout << "cofactor memo, one pass: " << hits << " hits, " << misses << " misses\n";
     }
-    return order;
-}
 
-bool coprime_orders4(uint64_t p)
-{
-    if(p == 2 || p == 3) return false;
-    const auto factors = factorint(p - 1);
-    const constexpr uint64_t two = 2;
-    const auto mo2 = order4(factors, two, p);
-    const constexpr uint64_t three = 3;
-    const auto mo3 = order4(factors, three, p);
-    for(auto n1 : mo2) {
-        if(std::binary_search(mo3.begin(), mo3.end(), n1)) {
-            return false;
+    ankerl::nanobench::Bench().run("factor the primes after 10^12 (primality proof, 52-bit instance)", [&] {
+        factors f;
+        for(auto p : sample) {
+            factor_word<52>(p, &f);
+            ankerl::nanobench::doNotOptimizeAway(f);
         }
-    } 
-    return true;
-}
-
-/*uint64_t mulmod5(uint64_t a, uint64_t b, uint64_t m) {
-  uint64_t r;
-  __asm__
-  ( "mulq %2\n\t"
-      "divq %3"
-      : "=&d" (r), "+%a" (a)
-      : "rm" (b), "rm" (m)
-      : "cc"
-  );
-  return r;
-}
-
-uint64_t modpow_two(uint64_t exponent, uint64_t modulus) {
-    uint64_t result = 1ull << (exponent % 64);
-    if(exponent < 64) return result % modulus;
-
-	uint64_t base = (1 + ~modulus) % modulus;
-    exponent >>= 6;
-
-    while (exponent > 0) {
-        if (exponent & 1) result = mulmod5(result, base, modulus);
-        base = mulmod5(base, base, modulus);
-        exponent >>= 1;
-    }
-    return result;
-}
-
-uint64_t modpow_three(uint64_t exponent, uint64_t modulus) {
-    uint64_t base = 3;
-    uint64_t result {1};
-    while (exponent > 0){
-        if (exponent & 1) result = mulmod2(result, base, modulus);
-        base = mulmod2(base, base, modulus);
-        exponent >>= 1;
-    }
-    return result;
-}
+    });
 
-std::vector<uint64_t> order_two(std::map<uint64_t, uint64_t> factors, uint64_t p) {
-    namespace view = std::ranges::views;
-    uint64_t group_order = p - 1;
-    std::vector<uint64_t> order;
-    for (const auto& [P, e] : factors)
-    {
-        uint64_t exponent = group_order;
-        for (const auto f: view::iota(0ull, e + 1))
-        {
-            if (modpow_two(exponent, p) != 1)
-            {
-                uint64_t alpha = P;
-                order.push_back(alpha);
-                
-                break;
-            }
-            exponent /= P;
+    ankerl::nanobench::Bench().run("factor the primes after 10^12 (primality proof, 64-bit instance)", [&] {
+        factors f;
+        for(auto p : sample) {
+            factor_word<64>(p, &f);
+            ankerl::nanobench::doNotOptimizeAway(f);
         }
+    });
 
-    }
-    return order;
-}
-
-bool order_three(std::map<uint64_t, uint64_t> factors, uint64_t p, std::vector<uint64_t> mo2) {
-    namespace view = std::ranges::views;
-    uint64_t group_order = p - 1;
-    std::vector<uint64_t> order;
-    for (const auto& [P, e] : factors)
     {
-        uint64_t exponent = group_order;
-        for (const auto f: view::iota(0ull, e + 1))
-        {
-            if (modpow_three(exponent, p) != 1)
-            {
-                uint64_t alpha = P;
-                if(std::binary_search(mo2.begin(), mo2.end(), alpha)) return false;
-                
-                break;
-            }
-            exponent /= P;
+        // what is left of p - 1 near 10^13 once the small primes are out:
+        // two primes between 10^5 and 3 * 10^6
+        const auto middle = batch(primes, 100'000, 3'000'000);
+        std::mt19937_64 rng(1);
+        std::vector<uint64_t> semiprimes;
+        while(semiprimes.size() != 2000) {
+            const uint64_t p = middle[rng() % middle.size()], q = middle[rng() % middle.size()];
+            if(p != q) semiprimes.push_back(p * q);
         }
-
-    }
-    return true;
-}
-
-bool coprime_orders5(uint64_t p)
-{
-    if(p == 2 || p == 3) return false;
-    const auto factors = factorint(p - 1);
-    const auto mo2 = order_two(factors, p);
-    
-    return  order_three(factors, p, mo2);
-}*/
-
-int main() {
-
-    std::vector<unsigned> primes; // all the primes less than 10^6.5
-
-    for(unsigned n = 2; n != 3'162'277; ++n) {
-		if(std::all_of(primes.begin(), primes.end(), [&](int i) {return n % i != 0;})) {
-			primes.push_back(n);
-		}
-	}
-
-    ankerl::nanobench::Bench().run("batch of 10^6 numbers after 10^12 (current)", [&] {
-        auto v = batch(primes, 1'000'000'000'000ull, 1'000'001'000'000ull);
-        for(auto i : v) {
-            ankerl::nanobench::doNotOptimizeAway(coprime_orders(i));
+        for(const unsigned length : {32u, 128u, 512u}) {
+            factors f;
+            ankerl::nanobench::Bench().run("factor semiprime cofactors near 10^13 (rho, gcd every " + std::to_string(length) + ")", [&] {
+                for(auto n : semiprimes) {
+                    factor_rho(n, &f, length);
+                    ankerl::nanobench::doNotOptimizeAway(f);
+                }
+            });
         }
-    });
+    }
 
-    ankerl::nanobench::Bench().run("batch of 10^6 numbers after 10^12 (overflow)", [&] {
-        auto v = batch(primes, 1'000'000'000'000ull, 1'000'001'000'000ull);
-        for(auto i : v) {
-            ankerl::nanobench::doNotOptimizeAway(coprime_orders0(i));
-        }
+    ankerl::nanobench::Bench().run("factor p - 1 for primes after 10^12 (factor sieve)", [&] {
+        factor_sieve sieve(primes, sample.front() - 1, sample.back());
+        for(auto p : sample) ankerl::nanobench::doNotOptimizeAway(sieve.factorize(p - 1));
     });
 
-    ankerl::nanobench::Bench().run("batch of 10^6 numbers after 10^12 (128 bit)", [&] {
+    ankerl::nanobench::Bench().run("batch of 10^6 numbers after 10^12 (vector pipeline, factor sieve)", [&] {
         auto v = batch(primes, 1'000'000'000'000ull, 1'000'001'000'000ull);
-        for(auto i : v) {
-            ankerl::nanobench::doNotOptimizeAway(coprime_orders1(i));
-        }
+        factor_sieve sieve(primes, 999'999'999'999ull, 1'000'000'999'999ull);
+        ankerl::nanobench::doNotOptimizeAway(coprime_orders(std::span<uint64_t>(v), sieve));
     });
 
-    ankerl::nanobench::Bench().run("batch of 10^6 numbers after 10^12 (assembly)", [&] {
+    ankerl::nanobench::Bench().run("batch of 10^6 numbers after 10^12 (current)", [&] {
         auto v = batch(primes, 1'000'000'000'000ull, 1'000'001'000'000ull);
         for(auto i : v) {
-            ankerl::nanobench::doNotOptimizeAway(coprime_orders2(i));
+            ankerl::nanobench::doNotOptimizeAway(coprime_orders(i));
         }
     });
 
-    ankerl::nanobench::Bench().run("batch of 10^6 numbers after 10^12 (peasant)", [&] {
-        auto v = batch(primes, 1'000'000'000'000ull, 1'000'001'000'000ull);
-        for(auto i : v) {
-            ankerl::nanobench::doNotOptimizeAway(coprime_orders3(i));
+    {
+        // the worker loop of ord23 on its own and with the telemetry and the
+        // metrics file of a long search, which should cost it under 1%
+        const auto worker = [&](telemetry *stats) {
+            const auto rho = rho_invocations();
+            const auto exps = exponentiations;
+            segmented_sieve sieve(primes, 1'000'000'000'000ull, 1'000'001'000'000ull);
+            coprime_pipeline pipeline;
+            std::vector<uint64_t> segment;
+            uint64_t hits {0};
+            while(sieve.next(segment)) {
+                hits += pipeline.run(segment);
+                segment.clear();
+            }
+            if(stats) {
+                stats->add(0, telemetry::block_totals(1'000'000, pipeline.counts(), hits, rho_invocations() - rho,
+                                                      exponentiations - exps));
+            }
+            return hits;
+        };
+        const auto median = [](ankerl::nanobench::Bench &bench) {
+            return bench.results().back().median(ankerl::nanobench::Result::Measure::elapsed);
+        };
+
+        ankerl::nanobench::Bench bare, counted;
+        bare.run("block of 10^6 numbers after 10^12 (worker)", [&] {
+            ankerl::nanobench::doNotOptimizeAway(worker(nullptr));
+        });
+        telemetry stats(1, 1'000'000'000'000ull, 1'000'000'000'000ull);
+        const auto path = (std::filesystem::temp_directory_path() / "ord23_profiling.prom").string();
+        {
+            metrics_exporter exporter(path, 0, std::chrono::seconds(1));
+            exporter.start([&] {return prometheus_metrics(stats, {0, 1'000'000'000'000ull, 0, 1'000, 0});});
+            counted.run("block of 10^6 numbers after 10^12 (worker, telemetry and metrics file)", [&] {
+                ankerl::nanobench::doNotOptimizeAway(worker(&stats));
+            });
         }
-    });
+        std::filesystem::remove(path);
+        std::cout << "telemetry overhead: " << 100 * (median(counted) / median(bare) - 1) << "%\n";
+    }
 
-    ankerl::nanobench::Bench().run("batch of 10^6 numbers after 10^12 (log hack)", [&] {
-        auto v = batch(primes, 1'000'000'000'000ull, 1'000'001'000'000ull);
-        for(auto i : v) {
-            ankerl::nanobench::doNotOptimizeAway(coprime_orders4(i));
-        }
-    });
+    for(const auto engine : modular_engines) {
+        ankerl::nanobench::Bench().run(std::string("batch of 10^6 numbers after 10^12 (") + engine_name(engine) + ")", [&] {
+            auto v = batch(primes, 1'000'000'000'000ull, 1'000'001'000'000ull);
+            for(auto i : v) {
+                ankerl::nanobench::doNotOptimizeAway(coprime_orders(i, engine));
+            }
+        });
+    }
+    std::cout << "fastest engine near 10^13: " << engine_name(fastest_engine(10'000'000'000'000ull)) << "\n";
     return 0;
 }
\ No newline at end of file
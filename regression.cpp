@@ -0,0 +1,64 @@
+#include "regression.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+
+// The number after "key": in json between from and until, or throws.
+double number_after(const std::string &json, const std::string &key, std::size_t from, std::size_t until) {
+    const auto at = json.find('"' + key + "\": ", from);
+    if(at == std::string::npos || at > until) throw std::runtime_error("benchmark result without " + key);
+    return std::strtod(json.c_str() + at + key.size() + 4, nullptr);
+}
+
+}
+
+std::vector<benchmark_result> parse_results(const std::string &json) {
+    if(json.find("\"results\": [") == std::string::npos) throw std::runtime_error("not nanobench JSON");
+
+    const std::string name_key = "\"name\": \"";
+    std::vector<benchmark_result> results;
+    for(auto at = json.find(name_key); at != std::string::npos;) {
+        const auto begin = at + name_key.size();
+        const auto end = json.find('"', begin);
+        if(end == std::string::npos) throw std::runtime_error("unterminated benchmark name");
+        const auto next = json.find(name_key, end);
+        const auto until = next == std::string::npos ? json.size() : next;
+
+        const double batch = number_after(json, "batch", end, until);
+        results.push_back({json.substr(begin, end - begin),
+                           number_after(json, "median(elapsed)", end, until) / (batch > 0 ? batch : 1),
+                           number_after(json, "medianAbsolutePercentError(elapsed)", end, until)});
+        at = next;
+    }
+    return results;
+}
+
+std::vector<benchmark_change> compare(const std::vector<benchmark_result> &baseline,
+                                      const std::vector<benchmark_result> &current, double threshold) {
+    std::vector<benchmark_change> changes;
+    for(const auto &now : current) {
+        const auto old = std::find_if(baseline.begin(), baseline.end(),
+                                      [&](const benchmark_result &r) {return r.name == now.name;});
+        if(old == baseline.end() || old->seconds <= 0) continue;
+        const double change = now.seconds / old->seconds - 1;
+        const double error = old->error + now.error;
+        changes.push_back({now.name, old->seconds, now.seconds, change, error, change - error > threshold});
+    }
+    return changes;
+}
+
+std::string report(const std::vector<benchmark_change> &changes) {
+    std::string text;
+    for(const auto &c : changes) {
+        char line[256];
+        std::snprintf(line, sizeof line, "%-45s %12.3f ns %12.3f ns %+8.2f%% ±%.2f%%%s\n", c.name.c_str(),
+                      c.before * 1e9, c.after * 1e9, 100 * c.change, 100 * c.error,
+                      c.regressed ? "  REGRESSED" : "");
+        text += line;
+    }
+    return text;
+}
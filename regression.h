@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Comparison of two runs of the benchmarks through the JSON nanobench
+// writes, so a baseline kept from one commit can gate the next.
+
+struct benchmark_result {
+    std::string name;
+    double seconds; // median per unit of the batch
+    double error;   // median absolute percent error, as a fraction
+};
+
+// The results in the output of nanobench's JSON template. Throws
+// std::runtime_error on anything else.
+std::vector<benchmark_result> parse_results(const std::string &json);
+
+struct benchmark_change {
+    std::string name;
+    double before;
+    double after;
+    double change;  // after / before - 1
+    double error;   // the error bars of both runs, added
+    bool regressed;
+};
+
+// Every result of current that baseline has too, in the order of current.
+// A benchmark regressed when it got slower by more than threshold, a
+// fraction, beyond its error bars.
+std::vector<benchmark_change> compare(const std::vector<benchmark_result> &baseline,
+                                      const std::vector<benchmark_result> &current, double threshold);
+
+// A table of the changes, one line each, with the regressions marked.
+std::string report(const std::vector<benchmark_change> &changes);
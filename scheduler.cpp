@@ -0,0 +1,65 @@
+#include "scheduler.h"
+
+#include <thread>
+#include <vector>
+
+range_scheduler::range_scheduler(uint64_t n_blocks, unsigned n_workers)
+    : runs(new run[n_workers]), n_runs(n_workers)
+{
+    for(unsigned w = 0; w != n_workers; ++w) {
+        runs[w].begin = n_blocks * w / n_workers;
+        runs[w].end = n_blocks * (w + 1) / n_workers;
+    }
+}
+
+bool range_scheduler::next(unsigned worker, uint64_t &block) {
+    do {
+        std::lock_guard guard(runs[worker].lock);
+        if(runs[worker].begin != runs[worker].end) {
+            block = runs[worker].begin++;
+            return true;
+        }
+    } while(steal(worker));
+    return false;
+}
+
+bool range_scheduler::steal(unsigned worker) {
+    for(;;) {
+        unsigned victim = worker;
+        uint64_t largest = 0;
+        for(unsigned w = 0; w != n_runs; ++w) {
+            std::lock_guard guard(runs[w].lock);
+            if(runs[w].end - runs[w].begin > largest) {
+                largest = runs[w].end - runs[w].begin;
+                victim = w;
+            }
+        }
+        if(largest == 0) return false;
+
+        uint64_t begin, end;
+        {
+            std::lock_guard guard(runs[victim].lock);
+            end = runs[victim].end;
+            begin = runs[victim].begin + (end - runs[victim].begin) / 2;
+            if(begin == end) continue; // the victim drained its run meanwhile
+            runs[victim].end = begin;
+        }
+        std::lock_guard guard(runs[worker].lock);
+        runs[worker].begin = begin;
+        runs[worker].end = end;
+        return true;
+    }
+}
+
+void run_blocks(uint64_t n_blocks, unsigned n_threads,
+                const std::function<void(unsigned, uint64_t)> &fn) {
+    range_scheduler scheduler(n_blocks, n_threads);
+    std::vector<std::thread> threads;
+    for(unsigned w = 0; w != n_threads; ++w) {
+        threads.emplace_back([&, w] {
+            uint64_t block;
+            while(scheduler.next(w, block)) fn(w, block);
+        });
+    }
+    for(auto &t : threads) t.join();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Hands out the blocks [0, n_blocks) to a fixed set of workers. Every worker
+// starts with one contiguous run of blocks and takes them from the front;
+// once its run is empty it steals the back half of the largest run left.
+class range_scheduler {
+public:
+    range_scheduler(uint64_t n_blocks, unsigned n_workers);
+
+    // Stores the next block for worker in block, false once every run is empty.
+    bool next(unsigned worker, uint64_t &block);
+
+private:
+    bool steal(unsigned worker);
+
+    struct alignas(64) run {
+        std::mutex lock;
+        uint64_t begin {0};
+        uint64_t end {0};
+    };
+    std::unique_ptr<run[]> runs;
+    unsigned n_runs;
+};
+
+// Calls fn(worker, block) for every block in [0, n_blocks) from n_threads
+// threads that live for the whole call.
+void run_blocks(uint64_t n_blocks, unsigned n_threads,
+                const std::function<void(unsigned, uint64_t)> &fn);
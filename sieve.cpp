@@ -0,0 +1,88 @@
+#include "sieve.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+uint64_t isqrt(uint64_t n) {
+    uint64_t r = std::sqrt(static_cast<double>(n));
+    while(r > 0 && (r > UINT32_MAX || r * r > n)) --r;
+    while(r < UINT32_MAX && (r + 1) * (r + 1) <= n) ++r;
+    return r;
+}
+
+std::vector<unsigned> primes_below(uint64_t limit) {
+    if(limit <= 5) {
+        std::vector<unsigned> small {2, 3};
+        while(!small.empty() && small.back() >= limit) small.pop_back();
+        return small;
+    }
+    const auto base = primes_below(isqrt(limit - 1) + 1);
+    segmented_sieve sieve(base, 0, limit);
+    std::vector<unsigned> primes;
+    primes.reserve(limit / std::log(double(limit)) * 1.2 + 16);
+    for(std::vector<uint64_t> segment; sieve.next(segment); segment.clear()) {
+        primes.insert(primes.end(), segment.begin(), segment.end());
+    }
+    return primes;
+}
+
+std::vector<unsigned> base_primes(uint64_t max) {
+    return max < 2 ? std::vector<unsigned>{} : primes_below(isqrt(max - 1) + 1);
+}
+
+// Bit i of a segment starting at the even number low stands for low + 2i + 1.
+segmented_sieve::segmented_sieve(std::span<const unsigned> primes, uint64_t min, uint64_t max,
+                                 std::size_t segment_bytes)
+    : bits(std::min<uint64_t>(std::max<std::size_t>(segment_bytes / sizeof(uint64_t), 1),
+                              max > min ? (max - min) / 128 + 2 : 1)),
+      low(min & ~uint64_t{1}), high(max), two(min <= 2 && 2 < max)
+{
+    if(!primes.empty() && primes.front() == 2) primes = primes.subspan(1);
+    sieving = {primes.begin(), std::partition_point(primes.begin(), primes.end(), [&](unsigned p) {
+        return uint64_t{p} * p < max;
+    })};
+    offsets.reserve(sieving.size());
+}
+
+bool segmented_sieve::next(std::vector<uint64_t> &out) {
+    if(low >= high) return false;
+
+    const uint64_t n_bits = std::min<uint64_t>(bits.size() * 64, (high - low) / 2);
+    const std::size_t n_words = (n_bits + 63) / 64;
+
+    std::fill_n(bits.begin(), n_words, ~uint64_t{0});
+    if(n_bits % 64) bits[n_words - 1] = (uint64_t{1} << (n_bits % 64)) - 1;
+    if(low == 0 && n_bits) bits[0] &= ~uint64_t{1}; // 1 is not a prime
+
+    // the primes whose square falls in this segment start sieving
+    const uint64_t end = low + 2 * n_bits;
+    while(offsets.size() != sieving.size() && uint64_t{sieving[offsets.size()]} * sieving[offsets.size()] < end) {
+        const uint64_t p = sieving[offsets.size()];
+        // first odd multiple of p above low, but never below p^2
+        auto m = std::max<uint64_t>(low / p + 1, p);
+        if(m % 2 == 0) ++m;
+        offsets.push_back(static_cast<uint32_t>((static_cast<__uint128_t>(m) * p - low - 1) / 2));
+    }
+
+    for(std::size_t k = 0; k != offsets.size(); ++k) {
+        const uint64_t p = sieving[k];
+        uint64_t i = offsets[k];
+        for(; i < n_bits; i += p) bits[i / 64] &= ~(uint64_t{1} << (i % 64));
+        offsets[k] = static_cast<uint32_t>(i - n_bits);
+    }
+
+    if(two) {
+        out.push_back(2);
+        two = false;
+    }
+    for(std::size_t w = 0; w != n_words; ++w) {
+        for(auto word = bits[w]; word; word &= word - 1) {
+            out.push_back(low + 2 * (64 * w + std::countr_zero(word)) + 1);
+        }
+    }
+
+    low += 2 * n_bits;
+    if(n_bits == 0) low = high;
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Largest r with r * r <= n.
+uint64_t isqrt(uint64_t n);
+
+// All the primes below limit, sieved with the primes below sqrt(limit).
+std::vector<unsigned> primes_below(uint64_t limit);
+
+// The base primes needed to sieve windows below max: every p with p*p < max.
+std::vector<unsigned> base_primes(uint64_t max);
+
+// Odd-only segmented sieve of Eratosthenes over [min, max).
+// Every segment is a bitmap of segment_bytes bytes, one bit per odd number,
+// so only one cache-sized block is live at a time (less for small windows).
+// Each base prime keeps the offset of its next odd multiple, so a segment
+// never rescans from min.
+// The base primes must contain every prime up to sqrt(max), and are only
+// viewed, so the workers of a search share one table that has to outlive
+// their sieves. A base prime joins when the segment reaches its square, and
+// its offset from the segment start is then always below max(p, segment
+// bits), so 32 bits hold it.
+class segmented_sieve {
+public:
+    static constexpr std::size_t default_segment_bytes {1 << 17}; // fits in L2
+
+    segmented_sieve(std::span<const unsigned> primes, uint64_t min, uint64_t max,
+                    std::size_t segment_bytes = default_segment_bytes);
+
+    // Appends the primes of the next segment to out, in increasing order.
+    // Returns false once the whole window has been sieved.
+    bool next(std::vector<uint64_t> &out);
+
+    // Even number at which the next segment starts.
+    uint64_t position() const { return low; }
+
+private:
+    std::vector<uint64_t> bits;
+    std::span<const unsigned> sieving; // the odd base primes p with p*p < max
+    std::vector<uint32_t> offsets;     // of the first offsets.size() of them
+    uint64_t low;
+    uint64_t high;
+    bool two;
+};
@@ -0,0 +1,137 @@
+#include "telemetry.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+namespace {
+
+// The fields of totals in slot order.
+void unpack(const telemetry::totals &t, uint64_t *f) {
+    const uint64_t values[] {t.numbers, t.blocks, t.primes, t.candidates, t.hits, t.rho, t.exponentiations,
+                             t.stage_ns[0], t.stage_ns[1], t.stage_ns[2], t.stage_ns[3]};
+    std::copy(std::begin(values), std::end(values), f);
+}
+
+telemetry::totals pack(const uint64_t *f) {
+    return {f[0], f[1], f[2], f[3], f[4], f[5], f[6], {f[7], f[8], f[9], f[10]}};
+}
+
+std::string duration(double seconds) {
+    const auto s = static_cast<uint64_t>(seconds);
+    char text[32];
+    std::snprintf(text, sizeof text, "%02llu:%02llu:%02llu", static_cast<unsigned long long>(s / 3600),
+                  static_cast<unsigned long long>(s / 60 % 60), static_cast<unsigned long long>(s % 60));
+    return text;
+}
+
+}
+
+telemetry::totals &telemetry::totals::operator+=(const totals &other) {
+    uint64_t mine[n_fields], theirs[n_fields];
+    unpack(*this, mine);
+    unpack(other, theirs);
+    for(std::size_t i = 0; i != n_fields; ++i) mine[i] += theirs[i];
+    return *this = pack(mine);
+}
+
+telemetry::totals telemetry::block_totals(uint64_t numbers, const pipeline_counts &counts, uint64_t hits,
+                                          uint64_t rho, uint64_t exps) {
+    return {numbers, 1, counts.residues.in, counts.factorize.in, hits, rho, exps,
+            {counts.residues.ns, counts.small_orders.ns, counts.factorize.ns, counts.large_orders.ns}};
+}
+
+telemetry::telemetry(unsigned n_workers, uint64_t range, uint64_t left)
+    : slots(std::make_unique<slot[]>(n_workers)), n_slots(n_workers), total(range), remaining(left),
+      start(std::chrono::steady_clock::now()) {}
+
+void telemetry::add(unsigned worker, const totals &delta) {
+    uint64_t values[n_fields];
+    unpack(delta, values);
+    auto &fields = slots[worker].fields;
+    for(std::size_t i = 0; i != n_fields; ++i) {
+        fields[i].store(fields[i].load(std::memory_order_relaxed) + values[i], std::memory_order_relaxed);
+    }
+    for(int stage = 0; stage != 4; ++stage) {
+        const double seconds = delta.stage_ns[stage] * 1e-9;
+        auto &bucket = slots[worker].latency[stage][std::lower_bound(std::begin(latency_bounds), std::end(latency_bounds),
+                                                                     seconds) - std::begin(latency_bounds)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+telemetry::totals telemetry::sum() const {
+    uint64_t values[n_fields] {};
+    for(unsigned w = 0; w != n_slots; ++w) {
+        for(std::size_t i = 0; i != n_fields; ++i) values[i] += slots[w].fields[i].load(std::memory_order_relaxed);
+    }
+    return pack(values);
+}
+
+std::array<telemetry::histogram, 4> telemetry::stage_latency() const {
+    std::array<histogram, 4> counts {};
+    for(unsigned w = 0; w != n_slots; ++w) {
+        for(int stage = 0; stage != 4; ++stage) {
+            for(std::size_t b = 0; b != n_buckets; ++b) {
+                counts[stage][b] += slots[w].latency[stage][b].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return counts;
+}
+
+double telemetry::elapsed() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string telemetry::status() const {
+    const auto t = sum();
+    const double seconds = elapsed();
+    const double rate = seconds > 0 ? t.numbers / seconds : 0;
+    const uint64_t left = remaining > t.numbers ? remaining - t.numbers : 0;
+    const uint64_t stages = t.stage_ns[0] + t.stage_ns[1] + t.stage_ns[2] + t.stage_ns[3];
+    const auto share = [&](int i) {return stages ? 100.0 * t.stage_ns[i] / stages : 0.0;};
+
+    char text[320];
+    std::snprintf(text, sizeof text,
+                  "[%s] %.2f%% done, %.3g numbers/s, %.3g primes/s, %.3g candidates/s, "
+                  "%.2f exponentiations/prime, %llu rho, %llu hits, stages %.0f/%.0f/%.0f/%.0f%%, ETA %s",
+                  duration(seconds).c_str(), total ? 100.0 * (total - left) / total : 100.0, rate,
+                  seconds > 0 ? t.primes / seconds : 0, seconds > 0 ? t.candidates / seconds : 0,
+                  t.primes ? double(t.exponentiations) / t.primes : 0, static_cast<unsigned long long>(t.rho),
+                  static_cast<unsigned long long>(t.hits), share(0), share(1), share(2), share(3),
+                  rate > 0 ? duration(left / rate).c_str() : "--:--:--");
+    return text;
+}
+
+std::string telemetry::summary() const {
+    const auto t = sum();
+    const double seconds = elapsed();
+
+    std::string text = "searched " + std::to_string(t.numbers) + " numbers in " + duration(seconds) + ": "
+                     + std::to_string(t.primes) + " primes, " + std::to_string(t.candidates) + " candidates, "
+                     + std::to_string(t.hits) + " hits, " + std::to_string(t.rho) + " rho, "
+                     + std::to_string(t.exponentiations) + " exponentiations\n";
+    for(int i = 0; i != 4; ++i) {
+        char line[96];
+        std::snprintf(line, sizeof line, "  %-13s %.3f s, %.1f ns per prime\n", stage_names[i], t.stage_ns[i] * 1e-9,
+                      t.primes ? double(t.stage_ns[i]) / t.primes : 0);
+        text += line;
+    }
+    return text;
+}
+
+status_reporter::status_reporter(const telemetry &stats, std::ostream &out, std::chrono::seconds period)
+    : reporter([this, &stats, &out, period] {
+          std::unique_lock guard(lock);
+          while(!wake.wait_for(guard, period, [this] {return stopping;})) out << stats.status() << std::endl;
+      }) {}
+
+status_reporter::~status_reporter() {
+    {
+        std::lock_guard guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    reporter.join();
+}
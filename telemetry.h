@@ -0,0 +1,97 @@
+#pragma once
+
+#include "pipeline.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Live counters of a search. Every worker adds to a slot of its own, padded
+// to a cache line, with relaxed loads and stores and no read-modify-write,
+// so counting costs the workers no contention; readers sum the slots and
+// may see a block half added.
+class telemetry {
+public:
+    static constexpr const char *stage_names[] {"residues", "small_orders", "factorize", "large_orders"};
+
+    // Upper bounds in seconds of the buckets of time a stage spends on one
+    // block; a last bucket takes the rest.
+    static constexpr double latency_bounds[] {0.001, 0.003, 0.01, 0.03, 0.1, 0.3, 1, 3, 10, 30, 100};
+    static constexpr std::size_t n_buckets {std::size(latency_bounds) + 1};
+    using histogram = std::array<uint64_t, n_buckets>;
+
+    struct totals {
+        uint64_t numbers {0};         // searched
+        uint64_t blocks {0};
+        uint64_t primes {0};          // found by the sieve
+        uint64_t candidates {0};      // primes whose p - 1 had to be factored
+        uint64_t hits {0};
+        uint64_t rho {0};             // cofactors given to Pollard rho
+        uint64_t exponentiations {0};
+        uint64_t stage_ns[4] {};      // the pipeline stages, in order
+
+        totals &operator+=(const totals &other);
+    };
+
+    // What a worker did on a block of numbers, from its pipeline's counters
+    // and the thread's rho and exponentiation counts over the block.
+    static totals block_totals(uint64_t numbers, const pipeline_counts &counts, uint64_t hits,
+                               uint64_t rho, uint64_t exps);
+
+    // range: numbers in the whole search, left: those still to search.
+    telemetry(unsigned n_workers, uint64_t range, uint64_t left);
+
+    // Only ever called by worker itself.
+    void add(unsigned worker, const totals &delta);
+
+    totals sum() const;
+
+    // Blocks by the time each stage took on them, bucket by bucket.
+    std::array<histogram, 4> stage_latency() const;
+
+    // Seconds since the telemetry was created.
+    double elapsed() const;
+
+    // One line with the rates so far and the time left.
+    std::string status() const;
+
+    // The totals of the run, for when it ends.
+    std::string summary() const;
+
+private:
+    static constexpr std::size_t n_fields {11};
+
+    struct alignas(64) slot {
+        std::atomic<uint64_t> fields[n_fields] {};
+        std::atomic<uint64_t> latency[4][n_buckets] {};
+    };
+
+    std::unique_ptr<slot[]> slots;
+    unsigned n_slots;
+    uint64_t total;
+    uint64_t remaining;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Writes the status line to out every period, from its own thread, until
+// destroyed.
+class status_reporter {
+public:
+    status_reporter(const telemetry &stats, std::ostream &out, std::chrono::seconds period);
+    ~status_reporter();
+
+    status_reporter(const status_reporter &) = delete;
+    status_reporter &operator=(const status_reporter &) = delete;
+
+private:
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping {false};
+    std::thread reporter;
+};
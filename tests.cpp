@@ -2,6 +2,18 @@
 #include "catch.hpp"
 
 #include "utils.h"
+#include "scheduler.h"
+#include "journal.h"
+#include "options.h"
+#include "factor_cache.h"
+#include "pipeline.h"
+#include "output.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "regression.h"
+#include <fstream>
+#include <random>
+#include <sys/wait.h>
 
 template <int Base, typename T>
 T modpow(T exponent, T modulus)
@@ -82,6 +94,64 @@ TEST_CASE( "factorint", "[factorint]" ) {
     REQUIRE( factorint(1234567) == Map({{127, 1}, {9721, 1}}) );
     REQUIRE( factorint(2345678) == Map({{2, 1}, {23, 1}, {50993, 1}}) );
     REQUIRE( factorint(500008) == Map({{2, 3}, {62501, 1}}) );
+
+    // strong pseudoprimes to the first prime bases, and large primes
+    REQUIRE( factorint(3215031751) == Map({{151, 1}, {751, 1}, {28351, 1}}) );
+    REQUIRE( factorint(3825123056546413051) == Map({{149491, 1}, {747451, 1}, {34233211, 1}}) );
+    REQUIRE( factorint(2305843009213693951) == Map({{2305843009213693951, 1}}) );
+    REQUIRE( factorint(18446744073709551557ull) == Map({{18446744073709551557ull, 1}}) );
+    REQUIRE( factorint(4611686014132420609) == Map({{2147483647, 2}}) );
+    REQUIRE( factorint(3474749660383) == Map({{1303, 1}, {16927, 1}, {157543, 1}}) );
+    REQUIRE( factorint(341550071728321) == Map({{10670053, 1}, {32010157, 1}}) );
+    REQUIRE( factorint((1ull << 52) - 1) == Map({{3, 1}, {5, 1}, {53, 1}, {157, 1}, {1613, 1}, {2731, 1}, {8191, 1}}) );
+
+    for(uint64_t n : {2ull, 12ull, 1'000'000'000'000ull, 999'999'999'988ull, 18'446'744'073'709'551'556ull}) {
+        const auto expected = factorint(n);
+        const auto factors = factorize(n);
+        REQUIRE( factors.count == expected.size() );
+        std::size_t i {0};
+        for(const auto& [P, e] : expected) {
+            REQUIRE( factors.f[i].p == P );
+            REQUIRE( factors.f[i].e == e );
+            ++i;
+        }
+    }
+
+    std::vector<uint64_t> block {0, 1, 2, 3, 4, 4999ull * 4999, 5003ull * 5003, 4999ull * 5003 * 2,
+                                 18'446'744'073'709'551'557ull, 18'446'744'073'709'551'556ull};
+    for(uint64_t n = 999'999'000'000ull; n != 999'999'001'000ull; ++n) block.push_back(n);
+    std::vector<struct factors> result(block.size());
+    factor_block(block.data(), block.size(), result.data());
+    for(std::size_t j = 0; j != block.size(); ++j) {
+        const auto expected = factorint(block[j]);
+        if(block[j] >> 52 == 0) {
+            struct factors wide, narrow;
+            factor_word<64>(block[j], &wide);
+            factor_word<52>(block[j], &narrow);
+            REQUIRE( std::equal(wide.p, wide.p + wide.nfactors, narrow.p, narrow.p + narrow.nfactors) );
+        }
+        std::map<uint64_t, uint64_t> got;
+        for(unsigned k = 0; k != result[j].nfactors; ++k) got[result[j].p[k]] = result[j].e[k];
+        REQUIRE( got == expected );
+
+        struct factors small;
+        factor_rest(factor_small(block[j], &small), &small);
+        REQUIRE( std::equal(small.p, small.p + small.nfactors, result[j].p, result[j].p + result[j].nfactors) );
+    }
+    REQUIRE( cofactor_is_prime(5009) );
+    REQUIRE( cofactor_is_prime(18'446'744'073'709'551'557ull) );
+    REQUIRE( cofactor_is_prime(4'611'686'018'427'387'847ull) );
+    REQUIRE( !cofactor_is_prime(5003ull * 5009) );
+    REQUIRE( !cofactor_is_prime(1'000'003ull * 1'000'033) );
+    REQUIRE( !cofactor_is_prime(4'294'967'291ull * 4'294'967'279) );
+
+    for(const unsigned length : {0u, 1u, 7u, 128u}) {
+        struct factors rho;
+        factor_rho(1'000'003ull * 1'000'033, &rho, length);
+        REQUIRE( rho.nfactors == 2 );
+        REQUIRE( rho.p[0] == 1'000'003 );
+        REQUIRE( rho.p[1] == 1'000'033 );
+    }
 }
 
 TEST_CASE( "modpow", "[modpow]" ) {
@@ -128,4 +198,596 @@ TEST_CASE( "multiplicative_order", "[multiplicative_order]" ) {
         REQUIRE( order_two(factors, p) == std::vector<uint64_t>{2, 11} );
         REQUIRE( std::gcd(int{22}, int{31}) == 1 );
     }
+
+    for(const auto p : primes_below(20'000)) {
+        if(p < 5) continue;
+        uint64_t order2 {1}, order3 {1};
+        for(uint64_t x = 2; x != 1; x = x * 2 % p) ++order2;
+        for(uint64_t x = 3; x != 1; x = x * 3 % p) ++order3;
+
+        const auto factors = factorint(p - 1);
+        std::vector<uint64_t> expected;
+        for(const auto& [P, e] : factors) {
+            if(order2 % P == 0) expected.push_back(P);
+        }
+        REQUIRE( order_two(factors, p) == expected );
+        REQUIRE( order_three(factors, p, expected) == (std::gcd(order2, order3) == 1) );
+        REQUIRE( coprime_orders(p) == (std::gcd(order2, order3) == 1) );
+    }
+}
+
+TEST_CASE( "segmented_sieve", "[sieve]" ) {
+
+    const std::vector<unsigned> primes {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31};
+
+    REQUIRE( batch(primes, 0, 30) == std::vector<uint64_t>{2, 3, 5, 7, 11, 13, 17, 19, 23, 29} );
+    REQUIRE( batch(primes, 2, 3) == std::vector<uint64_t>{2} );
+    REQUIRE( batch(primes, 3, 4) == std::vector<uint64_t>{3} );
+    REQUIRE( batch(primes, 14, 17) == std::vector<uint64_t>{} );
+    REQUIRE( batch(primes, 97, 114) == std::vector<uint64_t>{97, 101, 103, 107, 109, 113} );
+
+    std::vector<uint64_t> expected;
+    for(uint64_t n = 900; n != 1024; ++n) {
+        if(factorint(n) == std::map<uint64_t, uint64_t>{{n, 1}}) expected.push_back(n);
+    }
+    std::vector<uint64_t> out;
+    segmented_sieve sieve(primes, 900, 1024, 8);
+    while(sieve.next(out));
+    REQUIRE( out == expected );
+
+    // base primes join segment by segment as their squares come up
+    const auto base = primes_below(1'000);
+    out.clear();
+    segmented_sieve long_window(base, 0, 1'000'000, 8);
+    while(long_window.next(out));
+    REQUIRE( out.size() == 78'498 );
+    REQUIRE( out.back() == 999'983 );
+}
+
+TEST_CASE( "base_primes", "[sieve]" ) {
+
+    REQUIRE( isqrt(0) == 0 );
+    REQUIRE( isqrt(24) == 4 );
+    REQUIRE( isqrt(25) == 5 );
+    REQUIRE( isqrt(10'000'000'000'000) == 3'162'277 );
+    REQUIRE( isqrt(UINT64_MAX) == UINT32_MAX );
+
+    REQUIRE( primes_below(2) == std::vector<unsigned>{} );
+    REQUIRE( primes_below(3) == std::vector<unsigned>{2} );
+    REQUIRE( primes_below(30) == std::vector<unsigned>{2, 3, 5, 7, 11, 13, 17, 19, 23, 29} );
+    REQUIRE( primes_below(1'000'000).size() == 78'498 );
+
+    const auto primes = base_primes(10'000'000'000'000);
+    REQUIRE( primes.size() == 227'647 );
+    REQUIRE( primes.back() == 3'162'277 );
+    REQUIRE( base_primes(49) == std::vector<unsigned>{2, 3, 5} );
+    REQUIRE( base_primes(50) == std::vector<unsigned>{2, 3, 5, 7} );
+}
+
+TEST_CASE( "range_scheduler", "[scheduler]" ) {
+
+    for(const unsigned n_threads : {1u, 3u, 8u}) {
+        std::vector<std::atomic<int>> seen(1000);
+        std::atomic<unsigned> max_worker {0};
+        run_blocks(seen.size(), n_threads, [&](unsigned worker, uint64_t block) {
+            ++seen[block];
+            for(auto w = max_worker.load(); w < worker && !max_worker.compare_exchange_weak(w, worker););
+        });
+        REQUIRE( max_worker < n_threads );
+        REQUIRE( std::all_of(seen.begin(), seen.end(), [](const auto &s) {return s == 1;}) );
+    }
+
+    range_scheduler scheduler(5, 2);
+    std::vector<uint64_t> order;
+    for(uint64_t block; scheduler.next(0, block);) order.push_back(block);
+    REQUIRE( order == std::vector<uint64_t>{0, 1, 3, 4, 2} );
+}
+
+TEST_CASE( "progress_journal", "[journal]" ) {
+
+    const std::string path {"progress_journal_test.journal"};
+    std::remove(path.c_str());
+
+    {
+        progress_journal journal(path, 100, 1'050, 100, false);
+        REQUIRE( journal.pending().size() == 10 );
+        journal.complete(3, {331, 337});
+        journal.complete(0, {});
+        journal.complete(9, {1'031});
+        REQUIRE( journal.frontier() == 1 );
+        REQUIRE_THROWS( progress_journal(path, 100, 1'050, 100, false) );
+    }
+
+    // a record torn by a crash is dropped together with its block
+    std::ofstream(path, std::ios::app) << "hit 1 101\nhit 1 10";
+
+    {
+        REQUIRE_THROWS( progress_journal(path, 0, 1'050, 100, true) );
+        progress_journal journal(path, 100, 1'050, 100, true);
+        REQUIRE( journal.pending() == std::vector<uint64_t>{1, 2, 4, 5, 6, 7, 8} );
+        REQUIRE( journal.hits() == std::vector<uint64_t>{331, 337, 1'031} );
+        journal.complete(1, {101});
+    }
+
+    progress_journal journal(path, 100, 1'050, 100, true);
+    REQUIRE( journal.frontier() == 2 );
+    REQUIRE( journal.done(1) );
+    REQUIRE( journal.hits() == std::vector<uint64_t>{101, 331, 337, 1'031} );
+    std::remove(path.c_str());
+
+    // a file that is not a journal is left as it was
+    std::ofstream(path) << "ord23 100 1050";
+    REQUIRE_THROWS( progress_journal(path, 100, 1'050, 100, true) );
+    std::ifstream unchanged(path);
+    std::string text;
+    std::getline(unchanged, text);
+    REQUIRE( text == "ord23 100 1050" );
+    std::remove(path.c_str());
+}
+
+TEST_CASE( "ord23 startup", "[main]" ) {
+
+    // a search that fails to start leaves no journal to block the next run
+    const std::string journal = "startup_test.journal";
+    const auto ord23 = [&](const std::string &args) {
+        return std::system((std::string(ORD23_BINARY) + " --end 10^6 --status 0 -j " + journal + ' ' + args
+                            + " >/dev/null 2>&1").c_str());
+    };
+    std::remove(journal.c_str());
+    REQUIRE( ord23("--output /nonexistent/dir/hits.txt") != 0 );
+    REQUIRE( !std::ifstream(journal) );
+
+    REQUIRE( ord23("--metrics /nonexistent/dir/ord23.prom") != 0 );
+    REQUIRE( !std::ifstream(journal) );
+    {
+        // the port is taken by this exporter
+        uint16_t port = 40'000;
+        std::unique_ptr<metrics_exporter> busy;
+        while(!busy) {
+            try {
+                busy = std::make_unique<metrics_exporter>("", ++port, std::chrono::seconds(60));
+            }
+            catch(const std::runtime_error &) {}
+        }
+        REQUIRE( ord23("--metrics-port " + std::to_string(port)) != 0 );
+        REQUIRE( !std::ifstream(journal) );
+        REQUIRE_THROWS( metrics_exporter("", port, std::chrono::seconds(60)) );
+    }
+
+    REQUIRE( ord23("") == 0 );
+    REQUIRE( std::ifstream(journal) );
+    REQUIRE( ord23("") != 0 );
+    std::remove(journal.c_str());
+
+    // a resumed search shows the hits it had found but never writes them
+    // to the hits file again
+    const std::string hits = "startup_test_hits.txt";
+    std::remove(hits.c_str());
+    const auto lines = [&] {
+        std::ifstream file(hits);
+        return std::count(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), '\n');
+    };
+    REQUIRE( ord23("-o " + hits) == 0 );
+    REQUIRE( lines() == 2 );
+    REQUIRE( ord23("-o " + hits + " --resume") == 0 );
+    REQUIRE( ord23("-o " + hits + " --resume --json") == 0 );
+    REQUIRE( lines() == 2 );
+    std::remove(hits.c_str());
+    std::remove(journal.c_str());
+}
+
+TEST_CASE( "output_channel", "[output]" ) {
+
+    const auto hit = make_record(599'479, 7, std::chrono::system_clock::time_point(std::chrono::milliseconds(1'700'000'000'123)));
+    REQUIRE( hit.order_two == 33 );
+    REQUIRE( hit.order_three == 18'166 );
+    REQUIRE( to_json(hit) == "{\"p\":599479,\"ord2\":33,\"ord3\":18166,\"factors\":[[2,1],[3,1],[11,1],[31,1],[293,1]],"
+                             "\"block\":7,\"time\":\"2023-11-14T22:13:20.123Z\"}" );
+
+    std::ostringstream console, file;
+    {
+        output_channel out(console, &file, false);
+        std::vector<std::thread> workers;
+        for(uint64_t w = 0; w != 4; ++w) {
+            workers.emplace_back([&out, w] {
+                for(uint64_t i = 0; i != 1000; ++i) out.hit(683, w);
+                out.block_done(w);
+            });
+        }
+        for(auto &t : workers) t.join();
+    }
+    const auto written = file.str(), text = console.str();
+    REQUIRE( std::count(written.begin(), written.end(), '\n') == 4000 );
+    REQUIRE( std::count(text.begin(), text.end(), '.') == 4 );
+
+    std::ostringstream lines, kept;
+    {
+        output_channel out(lines, &kept, true);
+        out.hit(683, 0);
+        out.block_done(0);
+        out.replay(599'479, 3);
+    }
+    const auto json = lines.str(), file_lines = kept.str();
+    REQUIRE( json.rfind("{\"p\":683,\"ord2\":22,\"ord3\":31,", 0) == 0 );
+    REQUIRE( std::count(json.begin(), json.end(), '\n') == 2 );
+    REQUIRE( json.find("\"block\":3,\"time\":null}\n") != std::string::npos );
+    REQUIRE( std::count(file_lines.begin(), file_lines.end(), '\n') == 1 );
+}
+
+TEST_CASE( "telemetry", "[telemetry]" ) {
+
+    const auto rho = rho_invocations();
+    struct factors f;
+    factor(1'000'003ull * 1'000'033, &f);
+    REQUIRE( rho_invocations() > rho );
+
+    const auto exps = exponentiations;
+    REQUIRE( coprime_orders(599'479) );
+    REQUIRE( exponentiations > exps );
+
+    pipeline_counts counts;
+    counts.residues = {100, 40, 1'000};
+    counts.factorize = {10, 10, 3'000};
+    const auto block = telemetry::block_totals(1'000, counts, 1, 2, 300);
+    REQUIRE( block.primes == 100 );
+    REQUIRE( block.candidates == 10 );
+    REQUIRE( block.stage_ns[2] == 3'000 );
+
+    telemetry stats(4, 10'000, 8'000);
+    std::vector<std::thread> workers;
+    for(unsigned w = 0; w != 4; ++w) {
+        workers.emplace_back([&stats, &block, w] {
+            for(int i = 0; i != 2; ++i) stats.add(w, block);
+        });
+    }
+    for(auto &t : workers) t.join();
+    const auto sum = stats.sum();
+    REQUIRE( sum.numbers == 8'000 );
+    REQUIRE( sum.primes == 800 );
+    REQUIRE( sum.rho == 16 );
+    REQUIRE( sum.exponentiations == 2'400 );
+    REQUIRE( sum.stage_ns[0] == 8'000 );
+    REQUIRE( stats.status().find("100.00% done") != std::string::npos );
+    REQUIRE( stats.summary().rfind("searched 8000 numbers", 0) == 0 );
+}
+
+TEST_CASE( "metrics", "[telemetry]" ) {
+
+    telemetry stats(2, 4'000, 4'000);
+    pipeline_counts counts;
+    counts.residues = {100, 40, 2'000'000};
+    counts.large_orders = {5, 1, 50'000'000};
+    stats.add(0, telemetry::block_totals(1'000, counts, 1, 0, 300));
+    stats.add(1, telemetry::block_totals(1'000, counts, 0, 0, 300));
+
+    const auto text = prometheus_metrics(stats, {2'000, 4'000, 2, 4, 1});
+    const auto has = [&](const std::string &line) {return text.find(line + '\n') != std::string::npos;};
+    REQUIRE( has("# TYPE ord23_frontier gauge") );
+    REQUIRE( has("ord23_frontier 2000") );
+    REQUIRE( has("ord23_blocks_completed 2") );
+    REQUIRE( has("ord23_numbers_total 2000") );
+    REQUIRE( has("ord23_exponentiations_total 600") );
+    REQUIRE( has("ord23_stage_seconds_bucket{stage=\"residues\",le=\"0.001\"} 0") );
+    REQUIRE( has("ord23_stage_seconds_bucket{stage=\"residues\",le=\"0.003\"} 2") );
+    REQUIRE( has("ord23_stage_seconds_bucket{stage=\"large_orders\",le=\"0.03\"} 0") );
+    REQUIRE( has("ord23_stage_seconds_bucket{stage=\"large_orders\",le=\"+Inf\"} 2") );
+    REQUIRE( has("ord23_stage_seconds_sum{stage=\"large_orders\"} 0.1") );
+    REQUIRE( has("ord23_stage_seconds_count{stage=\"factorize\"} 2") );
+    REQUIRE( resident_bytes() > 0 );
+
+    const std::string path = "metrics_test.prom";
+    std::remove(path.c_str());
+    {
+        metrics_exporter exporter(path, 0, std::chrono::seconds(60));
+        exporter.start([] {return std::string("ord23_up 1\n");});
+    }
+    std::ifstream written(path);
+    std::string line;
+    REQUIRE( std::getline(written, line) );
+    REQUIRE( line == "ord23_up 1" );
+    std::remove(path.c_str());
+    std::ifstream temporary(path + ".tmp");
+    REQUIRE( !temporary );
+}
+
+TEST_CASE( "benchmark regressions", "[regression]" ) {
+
+    const auto run = [](double factor_p, double modpow) {
+        const auto result = [](const char *name, double batch, double median, double error) {
+            return std::string("        {\n            \"title\": \"ord23 kernels\",\n            \"name\": \"") + name
+                 + "\",\n            \"unit\": \"prime\",\n            \"batch\": " + std::to_string(batch)
+                 + ",\n            \"median(elapsed)\": " + std::to_string(median)
+                 + ",\n            \"medianAbsolutePercentError(elapsed)\": " + std::to_string(error) + "\n        }";
+        };
+        return "{\n    \"results\": [\n" + result("factor p - 1 at 10^13", 2000, factor_p, 0.01) + ",\n"
+             + result("modpow_two and modpow_three at 10^13", 2000, modpow, 0.02) + "\n    ]\n}\n";
+    };
+
+    const auto baseline = parse_results(run(0.008, 0.001));
+    REQUIRE( baseline.size() == 2 );
+    REQUIRE( baseline[0].name == "factor p - 1 at 10^13" );
+    REQUIRE( baseline[0].seconds == Catch::Approx(4e-6) );
+    REQUIRE( baseline[1].error == Catch::Approx(0.02) );
+    REQUIRE_THROWS( parse_results("<html></html>") );
+
+    // 10% slower with error bars of 2% fails a 5% threshold, 7% slower with 4% does not
+    auto changes = compare(baseline, parse_results(run(0.0088, 0.00107)), 0.05);
+    REQUIRE( changes.size() == 2 );
+    REQUIRE( changes[0].change == Catch::Approx(0.1) );
+    REQUIRE( changes[0].error == Catch::Approx(0.02) );
+    REQUIRE( changes[0].regressed );
+    REQUIRE( !changes[1].regressed );
+    REQUIRE( report(changes).find("REGRESSED") != std::string::npos );
+
+    changes = compare(baseline, parse_results(run(0.004, 0.001)), 0.05);
+    REQUIRE( std::none_of(changes.begin(), changes.end(), [](const auto &c) {return c.regressed;}) );
+    REQUIRE( compare({}, baseline, 0.05).empty() );
+}
+
+TEST_CASE( "benchmarks arguments", "[regression]" ) {
+
+    // usage errors exit 2 before anything is measured or written
+    const auto benchmarks = [](const std::string &args) {
+        const auto status = std::system((std::string(BENCHMARKS_BINARY) + " -o benchmarks_test.json " + args
+                                         + " >/dev/null 2>&1").c_str());
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    };
+    std::remove("benchmarks_test.json");
+    for(const auto *threshold : {"abc", "-5", "5x", "", "inf", "nan"}) {
+        REQUIRE( benchmarks(std::string("-t '") + threshold + "'") == 2 );
+    }
+    REQUIRE( benchmarks("--compare missing_baseline.json") == 2 );
+    REQUIRE( benchmarks("--filter 'at 10^14'") == 2 );
+    REQUIRE( !std::ifstream("benchmarks_test.json") );
+}
+
+TEST_CASE( "options", "[options]" ) {
+
+    REQUIRE( parse_number("12345") == 12'345 );
+    REQUIRE( parse_number("10^13") == 10'000'000'000'000 );
+    REQUIRE( parse_number("2^63") == 9'223'372'036'854'775'808ull );
+    REQUIRE( parse_number("25e12") == 25'000'000'000'000 );
+    REQUIRE_THROWS( parse_number("2^64") );
+    REQUIRE_THROWS( parse_number("18446744073709551616") );
+    REQUIRE_THROWS( parse_number("12x") );
+    REQUIRE_THROWS( parse_number("") );
+
+    auto parse = [](std::vector<std::string> args) {
+        std::vector<char *> argv;
+        for(auto &a : args) argv.push_back(a.data());
+        return parse_options(argv.size(), argv.data());
+    };
+
+    const auto defaults = parse({"ord23"});
+    REQUIRE( defaults.start == 0 );
+    REQUIRE( defaults.end == 10'000'000'000'000 );
+    REQUIRE( defaults.block == 100'000'000 );
+
+    const auto opts = parse({"ord23", "--start", "10^13", "--end=2e13", "-t", "3", "--block", "1e9",
+                             "--output", "hits.txt", "--resume", "--json", "--no-color", "--status", "0",
+                             "--metrics", "ord23.prom", "--metrics-port", "9423"});
+    REQUIRE( opts.start == 10'000'000'000'000 );
+    REQUIRE( opts.end == 20'000'000'000'000 );
+    REQUIRE( opts.threads == 3 );
+    REQUIRE( opts.block == 1'000'000'000 );
+    REQUIRE( opts.output == "hits.txt" );
+    REQUIRE( opts.resume );
+    REQUIRE( opts.json );
+    REQUIRE( !opts.color );
+    REQUIRE( !defaults.json );
+    REQUIRE( defaults.color );
+    REQUIRE( opts.status == 0 );
+    REQUIRE( defaults.status == 10 );
+    REQUIRE( opts.metrics == "ord23.prom" );
+    REQUIRE( opts.metrics_port == 9423 );
+    REQUIRE( defaults.metrics.empty() );
+    REQUIRE( defaults.metrics_port == 0 );
+    REQUIRE_THROWS( parse({"ord23", "--metrics-port", "65536"}) );
+
+    REQUIRE( parse({"ord23", "-s", "0", "-e", "5000"}).block == 1'000'000 );
+    REQUIRE_THROWS( parse({"ord23", "--start", "5", "--end", "5"}) );
+    REQUIRE_THROWS( parse({"ord23", "--bogus"}) );
+    REQUIRE_THROWS( parse({"ord23", "stray"}) );
+}
+
+TEST_CASE( "montgomery", "[modpow]" ) {
+
+    for(const uint64_t n : {35ull, 45ull, 9001ull, 1'000'000'007ull, 999'999'999'989ull,
+                            9'223'372'036'854'775'783ull, 18'446'744'073'709'551'557ull}) {
+        const montgomery m(n);
+        REQUIRE( m.n * m.ni == 1 );
+        REQUIRE( m.from(m.one) == 1 );
+        REQUIRE( m.from(m.to(n - 1)) == n - 1 );
+        for(const uint64_t e : std::vector<uint64_t>{0, 1, 18, 63, 64, 300, 5000, n - 1, n / 2}) {
+            REQUIRE( m.from(modpow_two(e, m)) == modpow_two(e, n) );
+            REQUIRE( m.from(modpow_three(e, m)) == modpow_three(e, n) );
+        }
+    }
+}
+
+TEST_CASE( "modular_engine", "[modpow]" ) {
+
+    std::mt19937_64 rng(1);
+    for(const uint64_t n : {35ull, 9001ull, 999'999'999'989ull, (1ull << 52) - 1, (1ull << 62) - 57,
+                            9'223'372'036'854'775'783ull, 18'446'744'073'709'551'557ull}) {
+        for(const auto engine : modular_engines) {
+            if(!supported(engine, n)) continue;
+            INFO( engine_name(engine) << " mod " << n );
+            with_engine(engine, n, [&](const auto &m) {
+                for(int i = 0; i != 1000; ++i) {
+                    const uint64_t a = rng() % n, b = i ? rng() % n : n - 1;
+                    REQUIRE( m.from(m.mul(m.to(a), m.to(b))) == static_cast<__uint128_t>(a) * b % n );
+                }
+                for(const uint64_t e : std::vector<uint64_t>{0, 1, 300, n - 1, n / 2}) {
+                    REQUIRE( m.from(modpow_two(e, m)) == modpow_two(e, n) );
+                    REQUIRE( m.from(modpow_three(e, m)) == modpow_three(e, n) );
+                }
+                return 0;
+            });
+        }
+    }
+    REQUIRE( !supported(modular_engine::long_double, 1ull << 63) );
+    REQUIRE( supported(fastest_engine(10'000'000'000'000), 10'000'000'000'000) );
+
+    for(const auto p : batch(base_primes(1'000'000'020'000), 1'000'000'000'000, 1'000'000'020'000)) {
+        for(const auto engine : modular_engines) {
+            REQUIRE( coprime_orders(p, engine) == coprime_orders(p) );
+        }
+    }
+}
+
+TEST_CASE( "filter_two_part", "[vector_kernel]" ) {
+
+    std::vector<uint64_t> primes {2, 3, 5, 7, 11, 13, 683, 599'479};
+    for(const auto start : {1'000'000ull, 1'000'000'000'000ull, (1ull << 50) - 20'000, (1ull << 52) - 10'000}) {
+        const auto window = batch(base_primes(start + 20'000), start, start + 20'000);
+        primes.insert(primes.end(), window.begin(), window.end());
+    }
+
+    std::vector<uint64_t> expected;
+    for(auto p : primes) {
+        if(p < 5) continue;
+        uint64_t odd = p - 1;
+        while(odd % 2 == 0) odd /= 2;
+        if(modpow_two(odd, p) == 1 || modpow_three(odd, p) == 1) expected.push_back(p);
+    }
+
+    for(const auto kernel : {two_part_kernel::scalar, two_part_kernel::avx2, two_part_kernel::ifma}) {
+        if(!supported(kernel)) continue;
+        auto filtered = primes;
+        filtered.resize(filter_two_part(filtered, kernel));
+        INFO( kernel_name(kernel) );
+        REQUIRE( filtered == expected );
+    }
+
+    two_part_counts counts;
+    auto filtered = primes;
+    filtered.resize(filter_two_part(filtered, best_two_part_kernel(), counts));
+    REQUIRE( filtered == expected );
+    REQUIRE( counts.primes == primes.size() );
+    REQUIRE( counts.residues == static_cast<uint64_t>(std::count_if(primes.begin(), primes.end(), [](uint64_t p) {
+        return p < 5 || p % 24 == 5 || p % 24 == 19;})) );
+    REQUIRE( counts.residues + counts.ladder == primes.size() - expected.size() );
+    REQUIRE( counts.decided == static_cast<uint64_t>(std::count_if(expected.begin(), expected.end(), [](uint64_t p) {return p % 4 == 3;})) );
+
+    auto hits = primes;
+    hits.resize(coprime_orders(std::span<uint64_t>(hits)));
+    std::vector<uint64_t> expected_hits;
+    std::copy_if(primes.begin(), primes.end(), std::back_inserter(expected_hits), [](uint64_t p) {return coprime_orders(p);});
+    REQUIRE( hits == expected_hits );
+    REQUIRE( std::count(hits.begin(), hits.end(), 683) == 1 );
+}
+
+TEST_CASE( "coprime_pipeline", "[pipeline]" ) {
+
+    const uint64_t start {1'000'000'000'000};
+    const auto base = base_primes(start + 100'000);
+    auto primes = batch(base, start, start + 100'000);
+    const std::vector<uint64_t> small {2, 3, 5, 7, 11, 13, 683, 599'479};
+    primes.insert(primes.begin(), small.begin(), small.end());
+    std::vector<uint64_t> expected;
+    std::copy_if(primes.begin(), primes.end(), std::back_inserter(expected), [](uint64_t p) {return coprime_orders(p);});
+
+    coprime_pipeline pipeline;
+    auto hits = primes;
+    hits.resize(pipeline.run(hits));
+    REQUIRE( hits == expected );
+
+    const auto &c = pipeline.counts();
+    REQUIRE( c.residues.in == primes.size() );
+    REQUIRE( c.small_orders.in == c.residues.kept );
+    REQUIRE( c.factorize.in == c.small_orders.kept );
+    REQUIRE( c.factorize.kept == c.factorize.in );
+    REQUIRE( c.large_orders.in == c.factorize.kept );
+    REQUIRE( c.large_orders.kept == expected.size() );
+
+    // lazily, without the full factorisation
+    for(auto p : primes) {
+        if(p < 5) continue;
+        REQUIRE( coprime_orders(p) == coprime_orders(factorize(p - 1), montgomery(p)) );
+    }
+
+    // the stages in another order, p - 1 from a factor sieve
+    factor_sieve factors(base, start - 1, start + 100'000);
+    coprime_pipeline sieved(&factors, two_part_kernel::scalar, modular_engine::barrett);
+    auto window = std::vector<uint64_t>(primes.begin() + small.size(), primes.end());
+    auto n = sieved.small_orders(window);
+    n = sieved.residues(std::span(window).first(n));
+    n = sieved.factorize(std::span(window).first(n));
+    window.resize(sieved.large_orders(std::span(window).first(n)));
+    REQUIRE( window == std::vector<uint64_t>(expected.begin() + 2, expected.end()) );
+    REQUIRE( sieved.counts().residues.kept == sieved.counts().residues.in );
+}
+
+TEST_CASE( "factor_sieve", "[factor_sieve]" ) {
+
+    const auto same = [](const factorization &a, const factorization &b) {
+        return a.count == b.count && std::equal(a.f, a.f + a.count, b.f, [](prime_power x, prime_power y) {
+            return x.p == y.p && x.e == y.e;
+        });
+    };
+
+    for(const auto [min, max, segment] : {std::tuple{0ull, 100'000ull, std::size_t{1000}},
+                                          std::tuple{999'999'000'001ull, 1'000'000'100'000ull, std::size_t{777}},
+                                          std::tuple{(1ull << 40) - 50'000, (1ull << 40) + 50'000, factor_sieve::default_segment}}) {
+        factor_sieve sieve(base_primes(max), min, max, segment);
+        for(uint64_t n = min + (min & 1) + (min == 0) * 2; n < max; n += 2) {
+            REQUIRE( same(sieve.factorize(n), factorize(n)) );
+        }
+    }
+
+    // skipping over whole segments, as for the sparse p - 1 of a prime window
+    const auto window = batch(base_primes(1'000'100'000ull), 1'000'000'000ull, 1'000'100'000ull);
+    factor_sieve sieve(base_primes(1'000'100'000ull), 999'999'999ull, 1'000'099'999ull, 64);
+    for(auto p : window) REQUIRE( same(sieve.factorize(p - 1), factorize(p - 1)) );
+
+    auto primes = batch(base_primes(10'000'000ull), 0, 10'000'000ull);
+    auto expected = primes;
+    expected.resize(coprime_orders(std::span<uint64_t>(expected)));
+    factor_sieve window_sieve(base_primes(10'000'000ull), 0, 10'000'000ull);
+    primes.resize(coprime_orders(primes, window_sieve));
+    REQUIRE( primes == expected );
+    REQUIRE( primes == std::vector<uint64_t>{683, 599'479} );
+}
+
+TEST_CASE( "factor_cache", "[factor_cache]" ) {
+
+    factor_cache cache(3);
+    uint64_t primes[factor_cache::max_primes];
+    REQUIRE( cache.find(35'000'011ull * 35'000'041, primes) == 0 );
+
+    for(uint64_t n = 1; n <= 3; ++n) {
+        const uint64_t p[] {n * 1000, n * 1001};
+        cache.insert(n, p, 2);
+    }
+    REQUIRE( cache.size() == 3 );
+    REQUIRE( cache.find(1, primes) == 2 );
+    REQUIRE( primes[1] == 1001 );
+
+    const uint64_t p4[] {4};
+    cache.insert(4, p4, 1); // evicts 2, the least recently used
+    REQUIRE( cache.size() == 3 );
+    REQUIRE( cache.find(2, primes) == 0 );
+    REQUIRE( cache.find(3, primes) == 2 );
+    REQUIRE( cache.find(4, primes) == 1 );
+    REQUIRE( cache.find(1, primes) == 2 );
+    REQUIRE( cache.hits() == 4 );
+    REQUIRE( cache.misses() == 2 );
+
+    // the memo is transparent to factor(), and only used while installed
+    factor_cache memo(1000);
+    const std::vector<uint64_t> numbers {2ull * 35'000'011 * 35'000'041, 4ull * 35'000'011 * 35'000'041,
+                                         1'000'000'000'039ull, 6ull * 1'000'000'000'039, 3825123056546413051ull};
+    std::vector<std::map<uint64_t, uint64_t>> expected;
+    for(auto n : numbers) expected.push_back(factorint(n));
+    {
+        factor_cache::scope scope(memo);
+        REQUIRE( factor_cache::current() == &memo );
+        for(int pass = 0; pass != 2; ++pass) {
+            for(std::size_t i = 0; i != numbers.size(); ++i) REQUIRE( factorint(numbers[i]) == expected[i] );
+        }
+    }
+    REQUIRE( factor_cache::current() == nullptr );
+    REQUIRE( memo.misses() == 3 );
+    REQUIRE( memo.hits() == 2 + 5 );
 }
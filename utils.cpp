@@ -1,16 +1,5 @@
 #include "utils.h"
-
-void now(std::atomic<bool>& running)
-{
-    while (running)
-    {
-        using namespace std::chrono_literals;
-        auto timestamp = std::chrono::system_clock::now();
-        auto tt = std::chrono::system_clock::to_time_t(timestamp);
-        std::cerr << std::put_time(std::localtime(&tt), "%F %T\n");
-        std::this_thread::sleep_for(10s);
-    }
-}
+#include "pipeline.h"
 
 std::map<uint64_t, uint64_t> factorint(const uint64_t num)
 {
@@ -25,6 +14,29 @@ std::map<uint64_t, uint64_t> factorint(const uint64_t num)
     return result;
 }
 
+factorization factorize(const factors &a)
+{
+    factorization result;
+    for (unsigned int j = 0; j < a.nfactors; j++)
+        result.f[result.count++] = {a.p[j], a.e[j]};
+    return result;
+}
+
+factorization factorize(uint64_t num)
+{
+    auto a = factors{};
+    factor(num, &a);
+    return factorize(a);
+}
+
+factorization factorize(const std::map<uint64_t, uint64_t> &factors)
+{
+    factorization result;
+    for (const auto& [P, e] : factors)
+        result.f[result.count++] = {P, e};
+    return result;
+}
+
 uint64_t mulmod(uint64_t a, uint64_t b, uint64_t m) {
   uint64_t r;
   __asm__
@@ -63,72 +75,250 @@ uint64_t modpow_three(uint64_t exponent, uint64_t modulus) {
     return result;
 }
 
+template <modular_arithmetic M>
+uint64_t modpow_two(uint64_t exponent, const M &m) {
+    return m.pow(m.add(m.one, m.one), exponent);
+}
+
+template <modular_arithmetic M>
+uint64_t modpow_three(uint64_t exponent, const M &m) {
+    return m.pow(m.add(m.add(m.one, m.one), m.one), exponent);
+}
+
+uint64_t multiplicative_order(uint64_t base, uint64_t p, factor_span factors) {
+    const montgomery m(p);
+    const auto b = m.to(base);
+    uint64_t order = p - 1;
+    for (const auto& [P, e] : factors) {
+        for(uint64_t i = 0; i != e && m.pow(b, order / P) == m.one; ++i) order /= P;
+    }
+    return order;
+}
+
 std::vector<uint64_t> order_two(std::map<uint64_t, uint64_t> factors, uint64_t p) {
-    namespace view = std::ranges::views;
-    uint64_t group_order = p - 1;
-    std::vector<uint64_t> order;
-    for (const auto& [P, e] : factors)
-    {
-        uint64_t exponent = group_order;
-        for (const auto f: view::iota(0ull, e + 1))
-        {
-            if (modpow_two(exponent, p) != 1)
-            {
-                uint64_t alpha = P;
-                order.push_back(alpha);
-                
-                break;
-            }
-            exponent /= P;
-        }
+    return order_two(factorize(factors), montgomery(p));
+}
 
+// A prime q with q^e || n divides the order of g exactly when g^(n / q^e) != 1.
+// Instead of one ladder per prime, split the primes in two halves and raise g
+// to the prime powers of the other half before descending into each, so every
+// level of the tree costs about one exponentiation to the full n.
+template <modular_arithmetic M>
+static void order_tree(const M &m, uint64_t base, const uint64_t *powers, std::size_t count, bool *divides) {
+    if(base == m.one) {
+        std::fill_n(divides, count, false);
+        return;
+    }
+    if(count == 1) {
+        divides[0] = true;
+        return;
+    }
+    const std::size_t half = count / 2;
+    uint64_t left {1}, right {1};
+    for(std::size_t i = 0; i != half; ++i) left *= powers[i];
+    for(std::size_t i = half; i != count; ++i) right *= powers[i];
+    order_tree(m, m.pow(base, right), powers, half, divides);
+    order_tree(m, m.pow(base, left), powers + half, count - half, divides + half);
+}
+
+static std::size_t prime_powers(factor_span factors, uint64_t *powers) {
+    std::size_t count {0};
+    for (const auto& [P, e] : factors) {
+        powers[count] = 1;
+        for(uint64_t i = 0; i != e; ++i) powers[count] *= P;
+        ++count;
+    }
+    return count;
+}
+
+template <modular_arithmetic M>
+void order_divisors(factor_span factors, const M &m, uint64_t base, bool *divides) {
+    uint64_t powers[MAX_NFACTS];
+    const auto count = prime_powers(factors, powers);
+    if(count) order_tree(m, base, powers, count, divides);
+}
+
+template <modular_arithmetic M>
+std::vector<uint64_t> order_two(factor_span factors, const M &m) {
+    bool divides[MAX_NFACTS];
+    order_divisors(factors, m, m.add(m.one, m.one), divides);
+    std::vector<uint64_t> order;
+    std::size_t i {0};
+    for (const auto& [P, e] : factors) {
+        if(divides[i++]) order.push_back(P);
     }
     return order;
 }
 
 bool order_three(std::map<uint64_t, uint64_t> factors, uint64_t p, std::vector<uint64_t> mo2) {
-    namespace view = std::ranges::views;
-    uint64_t group_order = p - 1;
-    std::vector<uint64_t> order;
-    for (const auto& [P, e] : factors)
-    {
-        uint64_t exponent = group_order;
-        for (const auto f: view::iota(0ull, e + 1))
-        {
-            if (modpow_three(exponent, p) != 1)
-            {
-                uint64_t alpha = P;
-                if(std::binary_search(mo2.begin(), mo2.end(), alpha)) return false;
-                
-                break;
-            }
-            exponent /= P;
-        }
+    return order_three(factorize(factors), montgomery(p), mo2);
+}
 
+template <modular_arithmetic M>
+bool order_three(factor_span factors, const M &m, const std::vector<uint64_t> &mo2) {
+    bool divides[MAX_NFACTS];
+    order_divisors(factors, m, m.add(m.add(m.one, m.one), m.one), divides);
+    std::size_t i {0};
+    for (const auto& [P, e] : factors) {
+        if(divides[i++] && std::binary_search(mo2.begin(), mo2.end(), P)) return false;
     }
     return true;
 }
 
+// order_tree for 2 and 3 at once. A subtree can only reject when both bases
+// are still != 1, and the leaves are visited smallest prime first, so q = 2,
+// which settles most primes, is decided before anything else is computed.
+template <modular_arithmetic M>
+static bool coprime_tree(const M &m, uint64_t two, uint64_t three, const uint64_t *powers, std::size_t count) {
+    if(two == m.one || three == m.one) return true;
+    if(count == 1) return false;
+
+    const std::size_t half = count / 2;
+    uint64_t left {1}, right {1};
+    for(std::size_t i = 0; i != half; ++i) left *= powers[i];
+    for(std::size_t i = half; i != count; ++i) right *= powers[i];
+
+    uint64_t two_part, three_part;
+    m.pow(two, three, right, two_part, three_part);
+    if(!coprime_tree(m, two_part, three_part, powers, half)) return false;
+    m.pow(two, three, left, two_part, three_part);
+    return coprime_tree(m, two_part, three_part, powers + half, count - half);
+}
+
+template <modular_arithmetic M>
+bool coprime_orders(factor_span factors, const M &m) {
+    uint64_t powers[MAX_NFACTS];
+    const auto count = prime_powers(factors, powers);
+    const auto two = m.add(m.one, m.one);
+    return count == 0 || coprime_tree(m, two, m.add(two, m.one), powers, count);
+}
+
+// The tree over the primes above skip of factors, each raised past what
+// the tree leaves out, then, if none divides both orders, the same over the
+// primes of rest, which is only factored at that point.
+template <modular_arithmetic M>
+static bool lazy_orders(factor_span factors, uint64_t rest, const M &m, uint64_t skip) {
+    uint64_t powers[MAX_NFACTS];
+    std::size_t count {0};
+    uint64_t known {1}, left_out {rest};
+    for (const auto& [P, e] : factors) {
+        uint64_t q {1};
+        for(uint64_t i = 0; i != e; ++i) q *= P;
+        known *= q;
+        if(P <= skip) left_out *= q;
+        else powers[count++] = q;
+    }
+    const auto two = m.add(m.one, m.one), three = m.add(two, m.one);
+    uint64_t two_part, three_part;
+    if(count) {
+        m.pow(two, three, left_out, two_part, three_part);
+        if(!coprime_tree(m, two_part, three_part, powers, count)) return false;
+    }
+    if(rest == 1) return true;
+
+    struct factors split;
+    split.nfactors = 0;
+    split.plarge[1] = 0;
+    factor_rest(rest, &split);
+    count = prime_powers(factorize(split), powers);
+    m.pow(two, three, known, two_part, three_part);
+    return coprime_tree(m, two_part, three_part, powers, count);
+}
+
+template <modular_arithmetic M>
+bool coprime_orders(factor_span factors, uint64_t rest, const M &m) {
+    return lazy_orders(factors, rest, m, 0);
+}
+
+template <modular_arithmetic M>
+bool coprime_large_orders(factor_span factors, const M &m, uint64_t rest) {
+    return lazy_orders(factors, rest, m, 3);
+}
+
+#define INSTANTIATE(M)                                                                           \
+    template uint64_t modpow_two(uint64_t exponent, const M &m);                                 \
+    template uint64_t modpow_three(uint64_t exponent, const M &m);                               \
+    template void order_divisors(factor_span factors, const M &m, uint64_t base, bool *divides); \
+    template std::vector<uint64_t> order_two(factor_span factors, const M &m);                   \
+    template bool order_three(factor_span factors, const M &m, const std::vector<uint64_t> &mo2); \
+    template bool coprime_orders(factor_span factors, const M &m);                               \
+    template bool coprime_orders(factor_span factors, uint64_t rest, const M &m);                \
+    template bool coprime_large_orders(factor_span factors, const M &m, uint64_t rest);
+
+INSTANTIATE(montgomery)
+INSTANTIATE(barrett)
+INSTANTIATE(int128_remainder)
+INSTANTIATE(divq_remainder)
+INSTANTIATE(float_quotient)
+
+const char *engine_name(modular_engine engine) {
+    switch(engine) {
+        case modular_engine::barrett: return "barrett";
+        case modular_engine::int128: return "int128";
+        case modular_engine::divq: return "divq";
+        case modular_engine::long_double: return "long double";
+        default: return "montgomery";
+    }
+}
+
+bool supported(modular_engine engine, uint64_t max) {
+    return engine != modular_engine::long_double || max <= float_quotient::limit;
+}
+
+modular_engine fastest_engine(uint64_t max) {
+    if(max < 1'000) return modular_engine::montgomery;
+    uint64_t moduli[64];
+    for(std::size_t i = 0; i != std::size(moduli); ++i) moduli[i] = (max - 2 - 2 * i) | 1;
+
+    auto best = modular_engine::montgomery;
+    auto best_time = std::chrono::steady_clock::duration::max();
+    volatile uint64_t sink {0};
+    for(const auto engine : modular_engines) {
+        if(!supported(engine, max)) continue;
+        for(int round = 0; round != 3; ++round) {
+            const auto start = std::chrono::steady_clock::now();
+            for(auto n : moduli) {
+                sink = sink + with_engine(engine, n, [&](const auto &m) {
+                    return modpow_two(n - 1, m) ^ modpow_three(n - 1, m);
+                });
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            if(elapsed < best_time) {
+                best_time = elapsed;
+                best = engine;
+            }
+        }
+    }
+    return best;
+}
+
+bool coprime_orders(uint64_t p, modular_engine engine) {
+    if(p == 2 || p == 3) return false;
+    factors small;
+    const auto rest = factor_small(p - 1, &small);
+    return with_engine(engine, p, [&](const auto &m) {return coprime_orders(factorize(small), rest, m);});
+}
+
 bool coprime_orders(uint64_t p) {
     if(p == 2 || p == 3) return false;
-    const auto factors = factorint(p - 1);
-    const auto mo2 = order_two(factors, p);
-    
-    return  order_three(factors, p, mo2);
+    factors small;
+    const auto rest = factor_small(p - 1, &small);
+    return coprime_orders(factorize(small), rest, montgomery(p));
+}
+
+std::size_t coprime_orders(std::span<uint64_t> primes) {
+    coprime_pipeline pipeline;
+    return pipeline.run(primes);
+}
+
+std::size_t coprime_orders(std::span<uint64_t> primes, factor_sieve &sieve) {
+    coprime_pipeline pipeline(&sieve);
+    return pipeline.run(primes);
 }
 
 std::vector<uint64_t> batch(const std::vector<unsigned> &primes, uint64_t min, uint64_t max) {
-    std::vector<bool> bools(max - min, true);
-    for(auto p : primes) {
-		uint64_t n = 1 + min / p; 
-		while(p * n < max) {
-			bools[p * n - min] = false;
-			++n;
-		}
-	}
     std::vector<uint64_t> out;
-    for(size_t iter = 1; iter != bools.size(); ++iter) {
-        if(bools[iter] && min + iter != 1) out.push_back(min + iter);
-    }
+    segmented_sieve sieve(primes, min, max);
+    while(sieve.next(out));
     return out;
 }
\ No newline at end of file
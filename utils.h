@@ -7,25 +7,111 @@
 #include <ranges>
 #include <thread>
 #include <map>
+#include <span>
 #include "factor.h"
+#include "factor_sieve.h"
+#include "sieve.h"
+#include "montgomery.h"
+#include "vector_kernel.h"
 #include <numeric>
 #include <vector>
 #include <algorithm>
 
-void now(std::atomic<bool>& running);
-
 std::map<uint64_t, uint64_t> factorint(const uint64_t num);
 
+factorization factorize(uint64_t num);
+
+factorization factorize(const std::map<uint64_t, uint64_t> &factors);
+
+factorization factorize(const factors &factors);
+
 uint64_t mulmod(uint64_t a, uint64_t b, uint64_t m);
 
 uint64_t modpow_two(uint64_t exponent, uint64_t modulus);
 
 uint64_t modpow_three(uint64_t exponent, uint64_t modulus);
 
+// The same with any modular_arithmetic; the result is in m's form, compare
+// it with m.one. The functions taking one below are instantiated for
+// montgomery and the engines of modular.h.
+template <modular_arithmetic M>
+uint64_t modpow_two(uint64_t exponent, const M &m);
+
+template <modular_arithmetic M>
+uint64_t modpow_three(uint64_t exponent, const M &m);
+
+// Sets divides[i] when the i-th prime of factors, the factorisation of m.n - 1,
+// divides the multiplicative order of base (in M's representation).
+template <modular_arithmetic M>
+void order_divisors(factor_span factors, const M &m, uint64_t base, bool *divides);
+
+// ord_p(base) for a prime p not dividing base, given the factorisation of p - 1.
+uint64_t multiplicative_order(uint64_t base, uint64_t p, factor_span factors);
+
 std::vector<uint64_t> order_two(std::map<uint64_t, uint64_t> factors, uint64_t p);
 
+template <modular_arithmetic M>
+std::vector<uint64_t> order_two(factor_span factors, const M &m);
+
 bool order_three(std::map<uint64_t, uint64_t> factors, uint64_t p, std::vector<uint64_t> mo2);
 
+template <modular_arithmetic M>
+bool order_three(factor_span factors, const M &m, const std::vector<uint64_t> &mo2);
+
+// Whether gcd(ord_p(2), ord_p(3)) = 1, given the factorisation of p - 1;
+// stops at the first prime that divides both orders.
+template <modular_arithmetic M>
+bool coprime_orders(factor_span factors, const M &m);
+
+// Lazy version, for p - 1 factored only as far as trial division goes:
+// factors holds the primes of (p - 1) / rest. The known primes are decided
+// first, and rest is factored only when none of them divides both orders.
+template <modular_arithmetic M>
+bool coprime_orders(factor_span factors, uint64_t rest, const M &m);
+
 bool coprime_orders(uint64_t p);
 
+// The engines behind modular_arithmetic, for picking one at run time.
+enum class modular_engine {montgomery, barrett, int128, divq, long_double};
+
+inline constexpr modular_engine modular_engines[] {modular_engine::montgomery, modular_engine::barrett,
+                                                   modular_engine::int128, modular_engine::divq,
+                                                   modular_engine::long_double};
+
+const char *engine_name(modular_engine engine);
+
+// Whether the engine works for every modulus up to max.
+bool supported(modular_engine engine, uint64_t max);
+
+// Times every supported engine on exponentiations modulo numbers just below
+// max and returns the fastest.
+modular_engine fastest_engine(uint64_t max);
+
+// f(m) with m the engine's arithmetic modulo the odd number n.
+template <typename F>
+decltype(auto) with_engine(modular_engine engine, uint64_t n, F &&f) {
+    switch(engine) {
+        case modular_engine::barrett: return f(barrett(n));
+        case modular_engine::int128: return f(int128_remainder(n));
+        case modular_engine::divq: return f(divq_remainder(n));
+        case modular_engine::long_double: return f(float_quotient(n));
+        default: return f(montgomery(n));
+    }
+}
+
+bool coprime_orders(uint64_t p, modular_engine engine);
+
+// coprime_orders for the primes above 3 only, for a p that has already
+// passed q = 2 and q = 3. Lazy in rest, as above.
+template <modular_arithmetic M>
+bool coprime_large_orders(factor_span factors, const M &m, uint64_t rest = 1);
+
+// Block version, through a coprime_pipeline: only the primes that pass the
+// cheap q = 2 and q = 3 tests are factored, with factor_block. Moves the
+// primes with coprime orders to the front and returns how many there are.
+std::size_t coprime_orders(std::span<uint64_t> primes);
+
+// Same, with p - 1 taken from a factor sieve over the window of the primes.
+std::size_t coprime_orders(std::span<uint64_t> primes, factor_sieve &sieve);
+
 std::vector<uint64_t> batch(const std::vector<unsigned> &primes, uint64_t min, uint64_t max);
\ No newline at end of file
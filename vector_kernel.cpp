@@ -0,0 +1,282 @@
+#include "vector_kernel.h"
+#include "montgomery.h"
+
+#include <algorithm>
+#include <immintrin.h>
+#include <vector>
+
+namespace {
+
+bool survives(uint64_t p) {
+    if(p < 5) return false;
+    const uint64_t odd = (p - 1) >> __builtin_ctzll(p - 1);
+    const montgomery m(p);
+    const uint64_t two = m.add(m.one, m.one);
+    uint64_t r2, r3;
+    m.pow(two, m.add(two, m.one), odd, r2, r3);
+    return r2 == m.one || r3 == m.one;
+}
+
+unsigned odd_part_bits(const uint64_t *primes, std::size_t lanes, uint64_t *odd) {
+    unsigned bits {0};
+    for(std::size_t l = 0; l != lanes; ++l) {
+        odd[l] = (primes[l] - 1) >> __builtin_ctzll(primes[l] - 1);
+        bits = std::max(bits, 64u - __builtin_clzll(odd[l]));
+    }
+    return bits;
+}
+
+// Runs kernel on every full chunk of lanes primes below limit and the scalar
+// test on everything else, then compacts the survivors.
+template <std::size_t lanes, typename Kernel>
+std::size_t filter_chunks(std::span<uint64_t> primes, uint64_t limit, Kernel kernel) {
+    std::size_t out {0}, i {0};
+    for(; i + lanes <= primes.size(); i += lanes) {
+        uint64_t chunk[lanes];
+        std::copy_n(&primes[i], lanes, chunk);
+        unsigned keep {0};
+        if(std::all_of(chunk, chunk + lanes, [&](uint64_t p) {return p >= 5 && p < limit;})) {
+            keep = kernel(chunk);
+        }
+        else {
+            for(std::size_t l = 0; l != lanes; ++l) keep |= unsigned{survives(chunk[l])} << l;
+        }
+        for(std::size_t l = 0; l != lanes; ++l) {
+            if(keep >> l & 1) primes[out++] = chunk[l];
+        }
+    }
+    for(; i != primes.size(); ++i) {
+        if(survives(primes[i])) primes[out++] = primes[i];
+    }
+    return out;
+}
+
+// Montgomery multiplication with R = 2^52 on the 52-bit multiplier, for
+// n < 2^52, inputs below n and ni = -n^-1 mod 2^52.
+__attribute__((target("avx512f,avx512ifma")))
+inline __m512i mul_ifma(__m512i a, __m512i b, __m512i n, __m512i ni) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i lo = _mm512_madd52lo_epu64(zero, a, b);
+    const __m512i hi = _mm512_madd52hi_epu64(zero, a, b);
+    const __m512i q = _mm512_madd52lo_epu64(zero, lo, ni);
+    const __m512i carry = _mm512_srli_epi64(_mm512_madd52lo_epu64(lo, q, n), 52);
+    const __m512i r = _mm512_add_epi64(_mm512_madd52hi_epu64(hi, q, n), carry);
+    return _mm512_min_epu64(r, _mm512_sub_epi64(r, n));
+}
+
+__attribute__((target("avx512f,avx512ifma")))
+unsigned two_part_ifma(const uint64_t *primes) {
+    constexpr uint64_t mask52 {(uint64_t{1} << 52) - 1};
+    alignas(64) uint64_t one[8], ni[8], odd[8];
+    for(std::size_t l = 0; l != 8; ++l) {
+        one[l] = (uint64_t{1} << 52) % primes[l];
+        ni[l] = -montgomery::inverse(primes[l]) & mask52;
+    }
+    const unsigned bits = odd_part_bits(primes, 8, odd);
+
+    const __m512i n = _mm512_loadu_si512(primes);
+    const __m512i inv = _mm512_load_si512(ni);
+    const __m512i r1 = _mm512_load_si512(one);
+    __m512i b2 = _mm512_add_epi64(r1, r1);
+    b2 = _mm512_min_epu64(b2, _mm512_sub_epi64(b2, n));
+    __m512i b3 = _mm512_add_epi64(b2, r1);
+    b3 = _mm512_min_epu64(b3, _mm512_sub_epi64(b3, n));
+    __m512i e = _mm512_load_si512(odd);
+    __m512i r2 = r1, r3 = r1;
+    const __m512i bit = _mm512_set1_epi64(1);
+
+    for(unsigned i = 0; i != bits; ++i) {
+        const __mmask8 set = _mm512_test_epi64_mask(e, bit);
+        r2 = _mm512_mask_mov_epi64(r2, set, mul_ifma(r2, b2, n, inv));
+        r3 = _mm512_mask_mov_epi64(r3, set, mul_ifma(r3, b3, n, inv));
+        b2 = mul_ifma(b2, b2, n, inv);
+        b3 = mul_ifma(b3, b3, n, inv);
+        e = _mm512_srli_epi64(e, 1);
+    }
+    return _mm512_cmpeq_epu64_mask(r2, r1) | _mm512_cmpeq_epu64_mask(r3, r1);
+}
+
+// a * b mod p in doubles for p < 2^50: the exact product is h + l, the
+// quotient estimate is off by at most one either way.
+__attribute__((target("avx2,fma")))
+inline __m256d mul_avx2(__m256d a, __m256d b, __m256d p, __m256d pinv) {
+    const __m256d h = _mm256_mul_pd(a, b);
+    const __m256d l = _mm256_fmsub_pd(a, b, h);
+    const __m256d q = _mm256_floor_pd(_mm256_mul_pd(h, pinv));
+    __m256d r = _mm256_add_pd(_mm256_fnmadd_pd(q, p, h), l);
+    r = _mm256_add_pd(r, _mm256_and_pd(_mm256_cmp_pd(r, _mm256_setzero_pd(), _CMP_LT_OQ), p));
+    return _mm256_sub_pd(r, _mm256_and_pd(_mm256_cmp_pd(r, p, _CMP_GE_OQ), p));
+}
+
+__attribute__((target("avx2,fma")))
+unsigned two_part_avx2(const uint64_t *primes) {
+    alignas(32) uint64_t odd[4];
+    alignas(32) double pd[4];
+    for(std::size_t l = 0; l != 4; ++l) pd[l] = static_cast<double>(primes[l]);
+    const unsigned bits = odd_part_bits(primes, 4, odd);
+
+    const __m256d p = _mm256_load_pd(pd);
+    const __m256d pinv = _mm256_div_pd(_mm256_set1_pd(1.0), p);
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d b2 = _mm256_set1_pd(2.0), b3 = _mm256_set1_pd(3.0);
+    __m256d r2 = one, r3 = one;
+    __m256i e = _mm256_load_si256(reinterpret_cast<const __m256i *>(odd));
+    const __m256i bit = _mm256_set1_epi64x(1);
+
+    for(unsigned i = 0; i != bits; ++i) {
+        const __m256d set = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(e, bit), bit));
+        r2 = _mm256_blendv_pd(r2, mul_avx2(r2, b2, p, pinv), set);
+        r3 = _mm256_blendv_pd(r3, mul_avx2(r3, b3, p, pinv), set);
+        b2 = mul_avx2(b2, b2, p, pinv);
+        b3 = mul_avx2(b3, b3, p, pinv);
+        e = _mm256_srli_epi64(e, 1);
+    }
+    return _mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(r2, one, _CMP_EQ_OQ),
+                                           _mm256_cmp_pd(r3, one, _CMP_EQ_OQ)));
+}
+
+__attribute__((target("avx512f,avx512ifma")))
+void product_lanes_ifma(const uint64_t *c, std::size_t count, const uint64_t *m, uint64_t *r) {
+    constexpr uint64_t mask52 {(uint64_t{1} << 52) - 1};
+    alignas(64) uint64_t ni[16];
+    for(std::size_t l = 0; l != 16; ++l) ni[l] = -montgomery::inverse(m[l]) & mask52;
+
+    // two independent chains, so one hides the latency of the other
+    const __m512i n0 = _mm512_loadu_si512(m), n1 = _mm512_loadu_si512(m + 8);
+    const __m512i i0 = _mm512_load_si512(ni), i1 = _mm512_load_si512(ni + 8);
+    __m512i r0 = _mm512_set1_epi64(1), r1 = _mm512_set1_epi64(1);
+    for(std::size_t i = 0; i != count; ++i) {
+        const __m512i b = _mm512_set1_epi64(c[i]);
+        r0 = mul_ifma(r0, b, n0, i0);
+        r1 = mul_ifma(r1, b, n1, i1);
+    }
+    _mm512_storeu_si512(r, r0);
+    _mm512_storeu_si512(r + 8, r1);
+}
+
+// Binary gcd, all lanes in step; a finished lane stays at x == y.
+__attribute__((target("avx512f,avx512cd")))
+inline __m512i gcd_avx512(__m512i x, __m512i y) {
+    const __m512i top = _mm512_set1_epi64(63);
+    const auto odd = [&](__m512i v) {
+        const __m512i low = _mm512_and_si512(v, _mm512_sub_epi64(_mm512_setzero_si512(), v));
+        return _mm512_srlv_epi64(v, _mm512_sub_epi64(top, _mm512_lzcnt_epi64(low)));
+    };
+    x = _mm512_mask_mov_epi64(odd(x), _mm512_testn_epi64_mask(x, x), y);
+    for(;;) {
+        const __m512i lo = _mm512_min_epu64(x, y);
+        const __m512i d = _mm512_sub_epi64(_mm512_max_epu64(x, y), lo);
+        const __mmask8 done = _mm512_testn_epi64_mask(d, d);
+        if(done == 0xff) return lo;
+        x = lo;
+        y = _mm512_mask_mov_epi64(odd(d), done, lo);
+    }
+}
+
+__attribute__((target("avx512f,avx512cd")))
+void gcd_lanes_avx512(uint64_t *a, const uint64_t *b) {
+    for(std::size_t l = 0; l != 16; l += 8) {
+        const __m512i g = gcd_avx512(_mm512_loadu_si512(a + l), _mm512_loadu_si512(b + l));
+        _mm512_storeu_si512(a + l, g);
+    }
+}
+
+// Legendre symbols from p mod 24: (2/p) = 1 for p = +-1 mod 8 and (3/p) = 1
+// for p = +-1 mod 12. a^m = 1 needs a to be a square, and for p = 3 mod 4,
+// where m = (p - 1) / 2, that is all it needs. So a class with neither square
+// is rejected, one with p = 3 mod 4 and a square passes, and only p = 1 mod 4
+// is left to the ladder. 2 and 3 fall in no class.
+constexpr uint32_t passing_classes {1u << 7 | 1u << 11 | 1u << 23};
+constexpr uint32_t ladder_classes {1u << 1 | 1u << 13 | 1u << 17};
+
+std::size_t ladder(std::span<uint64_t> primes, two_part_kernel kernel) {
+    switch(kernel) {
+        case two_part_kernel::ifma: return filter_chunks<8>(primes, uint64_t{1} << 52, two_part_ifma);
+        case two_part_kernel::avx2: return filter_chunks<4>(primes, uint64_t{1} << 50, two_part_avx2);
+        default: return filter_chunks<1>(primes, 0, [](const uint64_t *) {return 0u;});
+    }
+}
+
+const two_part_kernel best = [] {
+    if(supported(two_part_kernel::ifma)) return two_part_kernel::ifma;
+    if(supported(two_part_kernel::avx2)) return two_part_kernel::avx2;
+    return two_part_kernel::scalar;
+}();
+
+}
+
+bool supported(two_part_kernel kernel) {
+    __builtin_cpu_init();
+    switch(kernel) {
+        case two_part_kernel::ifma: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd")
+                                           && __builtin_cpu_supports("avx512ifma");
+        case two_part_kernel::avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        default: return true;
+    }
+}
+
+two_part_kernel best_two_part_kernel() {
+    return best;
+}
+
+const char *kernel_name(two_part_kernel kernel) {
+    switch(kernel) {
+        case two_part_kernel::ifma: return "avx512ifma";
+        case two_part_kernel::avx2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+std::size_t filter_residues(std::span<uint64_t> primes) {
+    std::size_t out {0};
+    for(auto p : primes) {
+        if((passing_classes | ladder_classes) >> (p % 24) & 1) primes[out++] = p;
+    }
+    return out;
+}
+
+std::size_t filter_two_part(std::span<uint64_t> primes, two_part_kernel kernel, two_part_counts &counts) {
+    thread_local std::vector<uint64_t> undecided;
+    undecided.clear();
+    std::size_t out {0};
+    for(auto p : primes) {
+        const auto r = p % 24;
+        if(ladder_classes >> r & 1) undecided.push_back(p);
+        if((passing_classes | ladder_classes) >> r & 1) primes[out++] = p;
+    }
+    const auto survivors = ladder(undecided, kernel);
+    counts.primes += primes.size();
+    counts.residues += primes.size() - out;
+    counts.decided += out - undecided.size();
+    counts.ladder += undecided.size() - survivors;
+
+    // both lists keep the order of primes, so the ladder's survivors are
+    // met in turn
+    std::size_t kept {0}, next {0};
+    for(std::size_t i = 0; i != out; ++i) {
+        const auto p = primes[i];
+        if(ladder_classes >> (p % 24) & 1) {
+            if(next == survivors || undecided[next] != p) continue;
+            ++next;
+        }
+        primes[kept++] = p;
+    }
+    return kept;
+}
+
+std::size_t filter_two_part(std::span<uint64_t> primes, two_part_kernel kernel) {
+    two_part_counts counts;
+    return filter_two_part(primes, kernel, counts);
+}
+
+std::size_t filter_two_part(std::span<uint64_t> primes) {
+    return filter_two_part(primes, best);
+}
+
+void product_lanes(const uint64_t *c, std::size_t count, const uint64_t *m, uint64_t *r) {
+    product_lanes_ifma(c, count, m, r);
+}
+
+void gcd_lanes(uint64_t *a, const uint64_t *b) {
+    gcd_lanes_avx512(a, b);
+}
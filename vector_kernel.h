@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// The q = 2 step of coprime_orders for a whole block of primes at once. With
+// p - 1 = 2^s * m and m odd, 2 divides ord(a) exactly when a^m != 1, so a
+// prime whose orders of 2 and 3 are both even is rejected from m alone,
+// before p - 1 is factored. Up to eight primes go through the ladder in
+// parallel lanes: AVX-512 IFMA Montgomery below 2^52, AVX2 doubles below
+// 2^50, chosen at run time. Other primes take the scalar Montgomery path.
+// Before any of that, the Legendre symbols of 2 and 3, read off p mod 24,
+// reject a quarter of the primes and pass the remaining ones with p = 3 mod 4,
+// so the ladder only sees p = 1 mod 4.
+
+enum class two_part_kernel {scalar, avx2, ifma};
+
+// The fastest kernel this machine supports, and its name.
+two_part_kernel best_two_part_kernel();
+const char *kernel_name(two_part_kernel kernel);
+
+bool supported(two_part_kernel kernel);
+
+// Moves the primes that survive the test to the front of primes, keeping
+// their order, and returns how many there are. 2 and 3 never survive.
+std::size_t filter_two_part(std::span<uint64_t> primes);
+
+// Same with a given kernel, which must be supported.
+std::size_t filter_two_part(std::span<uint64_t> primes, two_part_kernel kernel);
+
+// Only the p mod 24 part: drops the primes where neither 2 nor 3 is a square.
+std::size_t filter_residues(std::span<uint64_t> primes);
+
+// What each stage of filter_two_part did, summed over calls.
+struct two_part_counts {
+    uint64_t primes {0};   // tested
+    uint64_t residues {0}; // rejected from p mod 24
+    uint64_t decided {0};  // passed from p mod 24, without the ladder
+    uint64_t ladder {0};   // rejected by the ladder
+};
+
+std::size_t filter_two_part(std::span<uint64_t> primes, two_part_kernel kernel, two_part_counts &counts);
+
+// For sixteen odd m[l] < 2^52 and count factors c[i] < 2^52, sets r[l] to
+// c[0] * ... * c[count - 1] * 2^(-52 count) mod m[l], in IFMA lanes. The
+// power of two does not change gcd(r[l], m[l]), which is what
+// factor_block wants. Needs the ifma kernel.
+void product_lanes(const uint64_t *c, std::size_t count, const uint64_t *m, uint64_t *r);
+
+// a[l] = gcd(a[l], b[l]) for sixteen odd b[l]. Needs the ifma kernel.
+void gcd_lanes(uint64_t *a, const uint64_t *b);